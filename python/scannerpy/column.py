@@ -3,6 +3,11 @@ import cv2
 import math
 from common import *
 
+# Must match COLUMN_FILE_MAGIC in scanner/engine/db.h
+COLUMN_FILE_MAGIC = 0x324c4f43524e4353
+# Must match SEGMENT_FILE_MAGIC in scanner/engine/table_segments.h
+SEGMENT_FILE_MAGIC = 0x31474553524e4353
+
 
 class Column:
     """
@@ -19,44 +24,96 @@ class Column:
     def name(self):
         return self._descriptor.name
 
-    def _load_output_file(self, item_id, rows, fn=None):
-        assert len(rows) > 0
-
-        path = '{}/tables/{}/{}_{}.bin'.format(
-            self._db_path, self._table._descriptor.id,
-            self._descriptor.id, item_id)
+    def _read(self, path):
         try:
-            contents = self._storage.read(path)
+            return self._storage.read(path)
         except UserWarning:
             raise ScannerException('Path {} does not exist'.format(path))
 
-        lens = []
-        start_pos = None
-        pos = 0
-        (num_rows,) = struct.unpack("l", contents[:8])
+    def _read_segment(self, segment):
+        """
+        Reads a segment file and returns its contents along with a dict from
+        the item ids of this column to the (offset, size) of their data.
+        """
+        table_descriptor = self._table._descriptor
+        # Segments end with an index of (item, column, offset, size) entries,
+        # the number of entries and the magic
+        contents = self._read('{}/tables/{}/segment_{}.bin'.format(
+            self._db_path, table_descriptor.id, segment.name))
+        (num_entries, magic) = struct.unpack("LL", contents[-16:])
+        if magic != SEGMENT_FILE_MAGIC:
+            raise ScannerException('Segment {} of table {} has no index'
+                                   .format(segment.name,
+                                           table_descriptor.name))
+        index_start = len(contents) - 16 - num_entries * 32
+        items = {}
+        for i in range(num_entries):
+            (entry_item, entry_column, offset, size) = struct.unpack_from(
+                "qqLL", contents, index_start + i * 32)
+            if entry_column == self._descriptor.id:
+                items[entry_item] = (offset, size)
+        return (contents, items)
+
+    def _read_column_file(self, item_id, segments=None):
+        """
+        Reads the data of an item. segments caches the last segment read
+        across calls, so that the items of a segment are read with a single
+        read of it.
+        """
+        table_descriptor = self._table._descriptor
+        if segments is None:
+            segments = {}
+        if 'items' not in segments:
+            segments['items'] = {}
+            for s in table_descriptor.segments:
+                for i in s.item_ids:
+                    segments['items'][i] = s
+        segment = segments['items'].get(item_id)
+        if segment is None:
+            return self._read('{}/tables/{}/{}_{}.bin'.format(
+                self._db_path, table_descriptor.id, self._descriptor.id,
+                item_id))
+
+        if segments.get('name') != segment.name:
+            (segments['contents'], segments['index']) = \
+                self._read_segment(segment)
+            segments['name'] = segment.name
+        if item_id not in segments['index']:
+            raise ScannerException('Item {} missing from segment {} of table {}'
+                                   .format(item_id, segment.name,
+                                           table_descriptor.name))
+        (offset, size) = segments['index'][item_id]
+        return segments['contents'][offset:offset + size]
+
+    def _load_output_file(self, item_id, rows, fn=None, segments=None):
+        assert len(rows) > 0
 
-        i = 8
-        rows = rows if len(rows) > 0 else range(num_rows)
-        for fi in range(num_rows):
-            (buf_len,) = struct.unpack("l", contents[i:i+8])
-            i += 8
-            old_pos = pos
-            pos += buf_len
-            if start_pos is None:
-                start_pos = old_pos
-            lens.append(buf_len)
+        contents = self._read_column_file(item_id, segments)
 
-        rows_idx = 0
-        i = 8 + num_rows * 8 + start_pos
-        for j, buf_len in enumerate(lens):
-            if j == rows[rows_idx]:
-                buf = contents[i:i+buf_len]
-                if fn is not None:
-                    yield fn(buf)
-                else:
-                    yield buf
-                rows_idx += 1
-            i += buf_len
+        (first,) = struct.unpack("L", contents[:8])
+        if first == COLUMN_FILE_MAGIC:
+            # Offsets of every row followed by the row data
+            (num_rows,) = struct.unpack("L", contents[8:16])
+            data_start = 16 + (num_rows + 1) * 8
+            offsets = struct.unpack("{}L".format(num_rows + 1),
+                                    contents[16:data_start])
+        else:
+            # Files from before the magic only store the size of each row
+            num_rows = first
+            data_start = 8 + num_rows * 8
+            lens = struct.unpack("{}l".format(num_rows),
+                                 contents[8:data_start])
+            offsets = [0]
+            for buf_len in lens:
+                offsets.append(offsets[-1] + buf_len)
+
+        rows = rows if len(rows) > 0 else range(num_rows)
+        for r in rows:
+            buf = contents[data_start + offsets[r]:data_start + offsets[r + 1]]
+            if fn is not None:
+                yield fn(buf)
+            else:
+                yield buf
 
     def _load(self, fn=None, rows=None):
         table_descriptor = self._table._descriptor
@@ -72,6 +129,8 @@ class Column:
         rows_so_far = 0
         rows_idx = 0
         rows = range(total_rows) if rows is None else rows
+        # Shared by the reads of all items so each segment is read once
+        segments = {}
         for item_id in range(num_items):
             item_rows = total_rows % rows_per_item \
                         if item_id == num_items - 1 \
@@ -88,7 +147,8 @@ class Column:
                 else:
                     break
             if select_rows:
-                for output in self._load_output_file(item_id, select_rows, fn):
+                for output in self._load_output_file(item_id, select_rows, fn,
+                                                     segments):
                     yield (input_rows[i], output)
                     i += 1
             rows_so_far += item_rows
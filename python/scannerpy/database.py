@@ -430,6 +430,18 @@ class Database:
         self._delete_table(name)
         self._save_descriptor(db_meta, 'db_metadata.bin')
 
+    def compact_tables(self, names):
+        """
+        Packs the column files of tables written before table segments into
+        segments, which cuts the number of files a table takes up in storage.
+
+        Args:
+            names: List of table names.
+        """
+        error = self._bindings.compact_tables(self._db, names)
+        if error:
+            raise ScannerException(error)
+
     def table(self, name):
         db_meta = self._load_db_metadata()
 
@@ -552,7 +564,12 @@ class Database:
             work_item_size=250,
             cpu_pool=None,
             gpu_pool=None,
-            pipeline_instances_per_node=-1):
+            pipeline_instances_per_node=-1,
+            queue_sizes=None,
+            frame_cache=None,
+            prefetch_items=None,
+            prefetch_size=None,
+            dispatch=None):
         """
         Runs a computation over a set of inputs.
 
@@ -576,6 +593,23 @@ class Database:
             cpu_pool: TODO(wcrichto)
             gpu_pool: TODO(wcrichto)
             pipeline_instances_per_node: TODO(wcrichto)
+            queue_sizes: Optional dict mapping 'load', 'pre_eval', 'eval' or
+                         'save' to the capacity of the work queue feeding
+                         that pipeline stage.
+            frame_cache: Size of the per node cache of decoded frames, e.g.
+                         '512M', which lets overlapping samples reuse frames
+                         instead of decoding them again. The cache is off
+                         by default.
+            prefetch_items: Number of io items each load worker reads ahead
+                            of the one it is handing on. 0 disables read
+                            ahead.
+            prefetch_size: Size of the read ahead items a node holds, e.g.
+                           '256M', above which no more are started.
+            dispatch: Order in which the items of the tasks are handed out.
+                      'in_order' (default) runs the tasks one after another,
+                      'longest_first' starts the tasks with the most rows
+                      first and 'interleaved' hands out items of several
+                      tasks in turn.
 
         Returns:
             Either the output Collection if output_collection is specified
@@ -622,6 +656,36 @@ class Database:
         job_params.pipeline_instances_per_node = pipeline_instances_per_node
         job_params.work_item_size = work_item_size
 
+        if queue_sizes is not None:
+            for stage, size in queue_sizes.iteritems():
+                field = '{}_queue_size'.format(stage)
+                if not hasattr(job_params, field):
+                    raise ScannerException(
+                        'Unknown pipeline stage {} in queue_sizes'
+                        .format(stage))
+                setattr(job_params, field, size)
+
+        if frame_cache:
+            job_params.frame_cache_size = self._parse_size_string(frame_cache)
+
+        if prefetch_items is not None:
+            job_params.load_prefetch_items = \
+                prefetch_items if prefetch_items > 0 else -1
+        if prefetch_size is not None:
+            job_params.load_prefetch_bytes = \
+                self._parse_size_string(prefetch_size)
+
+        if dispatch is not None:
+            policies = {
+                'in_order': self.protobufs.InOrder,
+                'longest_first': self.protobufs.LongestFirst,
+                'interleaved': self.protobufs.Interleaved,
+            }
+            if dispatch not in policies:
+                raise ScannerException(
+                    'Unknown dispatch policy {}'.format(dispatch))
+            job_params.dispatch_policy = policies[dispatch]
+
         if cpu_pool is not None:
             job_params.memory_pool_config.cpu.use_pool = True
             size = self._parse_size_string(cpu_pool)
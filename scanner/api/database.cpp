@@ -16,6 +16,7 @@
 #include "scanner/api/database.h"
 #include "scanner/engine/runtime.h"
 #include "scanner/engine/ingest.h"
+#include "scanner/engine/table_segments.h"
 #include "scanner/engine/db.h"
 #include "scanner/engine/rpc.grpc.pb.h"
 #include "scanner/engine/rpc.pb.h"
@@ -150,6 +151,7 @@ machine_params_to_db_params(const MachineParameters &params,
   db.num_load_workers = params.num_load_workers;
   db.num_save_workers = params.num_save_workers;
   db.gpu_ids = params.gpu_ids;
+  db.num_load_io_threads = params.num_load_io_threads;
   return db;
 }
 }
@@ -159,6 +161,7 @@ MachineParameters default_machine_params() {
   machine_params.num_cpus = std::thread::hardware_concurrency();
   machine_params.num_load_workers = 2;
   machine_params.num_save_workers = 2;
+  machine_params.num_load_io_threads = 4;
 #ifdef HAVE_CUDA
   i32 gpu_count;
   CU_CHECK(cudaGetDeviceCount(&gpu_count));
@@ -252,6 +255,10 @@ Result Database::ingest_videos(const std::vector<std::string> &table_names,
   return job_result.result();
 }
 
+Result Database::compact_tables(const std::vector<std::string> &table_names) {
+  return internal::compact_tables(storage_config_, db_path_, table_names);
+}
+
 Result Database::new_job(JobParameters &params) {
   auto channel =
       grpc::CreateChannel(master_address_, grpc::InsecureChannelCredentials());
@@ -263,6 +270,13 @@ Result Database::new_job(JobParameters &params) {
   job_params.set_job_name(params.job_name);
   job_params.set_pipeline_instances_per_node(params.pipeline_instances_per_node);
   job_params.set_work_item_size(params.work_item_size);
+  job_params.set_load_queue_size(params.load_queue_size);
+  job_params.set_pre_eval_queue_size(params.pre_eval_queue_size);
+  job_params.set_eval_queue_size(params.eval_queue_size);
+  job_params.set_save_queue_size(params.save_queue_size);
+  job_params.set_frame_cache_size(params.frame_cache_size);
+  job_params.set_load_prefetch_items(params.load_prefetch_items);
+  job_params.set_load_prefetch_bytes(params.load_prefetch_bytes);
   proto::TaskSet set = consume_task_set(params.task_set);
   job_params.mutable_task_set()->Swap(&set);
   Result job_result;
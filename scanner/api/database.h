@@ -31,6 +31,8 @@ struct MachineParameters {
   i32 num_load_workers;
   i32 num_save_workers;
   std::vector<i32> gpu_ids;
+  // Threads reading io items ahead for the load workers, 0 disables read ahead
+  i32 num_load_io_threads;
 };
 
 MachineParameters default_machine_params();
@@ -59,6 +61,22 @@ struct JobParameters {
   MemoryPoolConfig memory_pool_config;
   i32 pipeline_instances_per_node;
   i64 work_item_size;
+
+  // Capacity of the work queues feeding each pipeline stage. Zero selects
+  // the default.
+  i32 load_queue_size = 0;
+  i32 pre_eval_queue_size = 0;
+  i32 eval_queue_size = 0;
+  i32 save_queue_size = 0;
+
+  // Bytes of decoded frames cached per node. Zero disables the cache.
+  i64 frame_cache_size = 0;
+
+  // Io items each load worker reads ahead and the bytes of read items per
+  // node above which no more are started. Zero selects the default and a
+  // negative number of items disables read ahead.
+  i32 load_prefetch_items = 0;
+  i64 load_prefetch_bytes = 0;
 };
 
 struct FailedVideo {
@@ -86,6 +104,10 @@ public:
 
   Result new_job(JobParameters &params);
 
+  // Packs the column files of tables written before table segments into
+  // segments
+  Result compact_tables(const std::vector<std::string> &table_names);
+
   Result shutdown_master();
 
   Result shutdown_worker();
@@ -36,7 +36,8 @@ void VideoKernel::check_frame_info(const DeviceHandle &device,
   delete_buffer(CPU_DEVICE, buffer);
 
   if (frame_info.width() != frame_info_.width() ||
-      frame_info.height() != frame_info_.height()) {
+      frame_info.height() != frame_info_.height() ||
+      frame_info.format() != frame_info_.format()) {
     frame_info_ = frame_info;
     new_frame_info();
   }
@@ -49,8 +50,9 @@ KernelRegistration::KernelRegistration(const KernelBuilder &builder) {
   DeviceType type = builder.device_type_;
   i32 num_devices = builder.num_devices_;
   KernelConstructor constructor = builder.constructor_;
-  internal::KernelFactory *factory =
-      new internal::KernelFactory(name, type, num_devices, 0, constructor);
+  internal::KernelFactory *factory = new internal::KernelFactory(
+      name, type, num_devices, 0, builder.frame_formats_,
+      builder.max_frame_size_, constructor);
   internal::KernelRegistry *registry = internal::get_kernel_registry();
   registry->add_kernel(name, factory);
 }
@@ -18,6 +18,8 @@
 #include "scanner/util/common.h"
 #include "scanner/util/profiler.h"
 
+#include <functional>
+#include <tuple>
 #include <vector>
 
 namespace scanner {
@@ -141,6 +143,11 @@ class KernelBuilder;
 
 using KernelConstructor = std::function<Kernel*(const Kernel::Config& config)>;
 
+// Returns the largest frame width and height a kernel needs, with 0 for a
+// dimension it needs at full size
+using MaxFrameSizeFunction =
+    std::function<std::tuple<i32, i32>(const Kernel::Config& config)>;
+
 class KernelRegistration {
  public:
   KernelRegistration(const KernelBuilder& builder);
@@ -164,11 +171,46 @@ public:
     return *this;
   }
 
+  /**
+   * @brief Frame formats the kernel accepts for video frames it reads
+   *        directly from a table, in no particular order.
+   *
+   * Kernels that declare formats other than RGB24 must check
+   * frame_info_.format() since any of the declared formats may be handed to
+   * them.
+   */
+  KernelBuilder& frame_formats(const std::vector<FrameFormat>& formats) {
+    frame_formats_ = formats;
+    return *this;
+  }
+
+  /**
+   * @brief Largest video frames the kernel needs, computed from its config.
+   *
+   * When every op reading frames from a table declares a bound, frames
+   * larger than it are shrunk while decoding. Width and height are shrunk
+   * independently, so kernels declaring a bound must not rely on the aspect
+   * ratio of the source video.
+   */
+  KernelBuilder& max_frame_size(MaxFrameSizeFunction max_frame_size) {
+    max_frame_size_ = max_frame_size;
+    return *this;
+  }
+
+  KernelBuilder& max_frame_size(i32 width, i32 height) {
+    max_frame_size_ = [width, height](const Kernel::Config& config) {
+      return std::make_tuple(width, height);
+    };
+    return *this;
+  }
+
  private:
   std::string name_;
   KernelConstructor constructor_;
   DeviceType device_type_;
   i32 num_devices_;
+  std::vector<FrameFormat> frame_formats_ = {FrameFormat::RGB24};
+  MaxFrameSizeFunction max_frame_size_;
 };
 
 }
@@ -229,6 +229,16 @@ std::vector<i64> VideoMetadata::keyframe_byte_offsets() const {
                           descriptor_.keyframe_byte_offsets().end());
 }
 
+std::vector<i64> VideoMetadata::non_reference_frames() const {
+  return std::vector<i64>(descriptor_.non_reference_frames().begin(),
+                          descriptor_.non_reference_frames().end());
+}
+
+std::vector<i64> VideoMetadata::non_reference_packets() const {
+  return std::vector<i64>(descriptor_.non_reference_packets().begin(),
+                          descriptor_.non_reference_packets().end());
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// ImageFormatGroupMetadata
 ImageFormatGroupMetadata::ImageFormatGroupMetadata() {}
@@ -336,6 +346,11 @@ TableMetadata::TableMetadata(const TableDescriptor &table) : Metadata(table) {
   for (auto &c : descriptor_.columns()) {
     columns_.push_back(c);
   }
+  for (i32 i = 0; i < descriptor_.segments_size(); ++i) {
+    for (i64 item_id : descriptor_.segments(i).item_ids()) {
+      item_segments_[item_id] = i;
+    }
+  }
 }
 
 std::string TableMetadata::descriptor_path(i32 table_id) {
@@ -384,6 +399,14 @@ ColumnType TableMetadata::column_type(i32 column_id) const {
   LOG(FATAL) << "Column id " << column_id << " not found!";
 }
 
+std::string TableMetadata::item_segment(i64 item_id) const {
+  auto it = item_segments_.find(item_id);
+  if (it == item_segments_.end()) {
+    return "";
+  }
+  return descriptor_.segments(it->second).name();
+}
+
 namespace {
 std::string &get_database_path_ref() {
   static std::string prefix = "";
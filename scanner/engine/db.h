@@ -52,6 +52,17 @@ inline std::string table_item_output_path(i32 table_id, i32 column_id,
          std::to_string(item_id) + ".bin";
 }
 
+inline std::string table_segment_path(i32 table_id, const std::string &name) {
+  return table_directory(table_id) + "/segment_" + name + ".bin";
+}
+
+// Column files start with COLUMN_FILE_MAGIC and the number of rows, followed
+// by num_rows + 1 byte offsets of the rows relative to the end of the offsets
+// (the last one is the size of the row data) and then the row data. Files
+// written before the magic was introduced start with the number of rows
+// followed by the size of each row.
+const u64 COLUMN_FILE_MAGIC = 0x324c4f43524e4353;  // "SCNRCOL2"
+
 inline std::string
 table_item_video_metadata_path(i32 table_id, i32 column_id, i32 item_id) {
   return table_directory(table_id) + "/" + std::to_string(column_id) + "_" +
@@ -141,6 +152,8 @@ class VideoMetadata : public Metadata<proto::VideoDescriptor> {
   i32 height() const;
   std::vector<i64> keyframe_positions() const;
   std::vector<i64> keyframe_byte_offsets() const;
+  std::vector<i64> non_reference_frames() const;
+  std::vector<i64> non_reference_packets() const;
 };
 
 class ImageFormatGroupMetadata : public Metadata<proto::ImageFormatGroupDescriptor> {
@@ -213,8 +226,14 @@ public:
 
   ColumnType column_type(i32 column_id) const;
 
+  // Name of the segment holding the columns of an item, empty if they are
+  // stored in a file per column
+  std::string item_segment(i64 item_id) const;
+
  private:
   std::vector<proto::Column> columns_;
+  // Index into the segments of the descriptor
+  std::map<i64, i32> item_segments_;
 };
 
 
@@ -0,0 +1,94 @@
+/* Copyright 2016 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/engine/dispatch.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <numeric>
+
+namespace scanner {
+namespace internal {
+
+TaskDispatcher::TaskDispatcher(proto::DispatchPolicy policy,
+                               const std::vector<i64>& task_rows,
+                               size_t num_workers) {
+  task_order_.resize(task_rows.size());
+  std::iota(task_order_.begin(), task_order_.end(), 0);
+
+  switch (policy) {
+    case proto::InOrder: {
+      break;
+    }
+    case proto::LongestFirst: {
+      std::stable_sort(task_order_.begin(), task_order_.end(),
+                       [&task_rows](i64 a, i64 b) {
+                         return task_rows[a] > task_rows[b];
+                       });
+      break;
+    }
+    case proto::Interleaved: {
+      // One task per worker, so a long task at the end of the list shares
+      // the nodes with the others instead of running on its own
+      max_active_tasks_ = std::max((size_t)1, num_workers);
+      break;
+    }
+    default: {
+      LOG(WARNING) << "Unknown dispatch policy " << policy
+                   << ", dispatching tasks in order";
+      break;
+    }
+  }
+}
+
+i64 TaskDispatcher::next_task(const StartTask& start_task, bool& last_sample) {
+  while (active_tasks_.size() < max_active_tasks_ &&
+         next_task_ < (i64)task_order_.size()) {
+    i64 task = task_order_[next_task_];
+    i64 samples = start_task(task);
+    if (samples < 0) {
+      stop();
+      return -1;
+    }
+    next_task_++;
+    if (samples > 0) {
+      active_tasks_.push_back(ActiveTask{task, samples});
+    }
+  }
+  if (active_tasks_.empty()) {
+    return -1;
+  }
+
+  next_active_task_ %= active_tasks_.size();
+  ActiveTask& active = active_tasks_[next_active_task_];
+  i64 task = active.task;
+  active.samples_left--;
+  last_sample = active.samples_left == 0;
+  if (last_sample) {
+    active_tasks_.erase(active_tasks_.begin() + next_active_task_);
+  } else {
+    next_active_task_++;
+  }
+  return task;
+}
+
+void TaskDispatcher::stop() {
+  next_task_ = task_order_.size();
+  active_tasks_.clear();
+}
+
+}
+}
@@ -0,0 +1,76 @@
+/* Copyright 2016 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "scanner/engine/rpc.pb.h"
+#include "scanner/util/common.h"
+
+#include <functional>
+#include <vector>
+
+namespace scanner {
+namespace internal {
+
+///////////////////////////////////////////////////////////////////////////////
+/// TaskDispatcher
+///
+/// Decides the order the master starts the tasks of a job in and which of the
+/// started tasks each io item is taken from. LongestFirst ranks tasks by the
+/// rows they sample. Profiles of earlier jobs are not used for the ranking
+/// since they are not broken down by task. The dispatcher is not thread safe,
+/// apart from task_order, which does not change after construction.
+class TaskDispatcher {
+ public:
+  // Starts a task and returns the number of samples it hands out, or -1 if
+  // it failed to start
+  using StartTask = std::function<i64(i64 task)>;
+
+  TaskDispatcher() = default;
+
+  // task_rows holds the rows sampled by each task. Interleaved jobs hand out
+  // the items of up to num_workers tasks in turn.
+  TaskDispatcher(proto::DispatchPolicy policy,
+                 const std::vector<i64>& task_rows, size_t num_workers);
+
+  // Returns the task the next io item is taken from, starting tasks as
+  // needed, or -1 if every task has been handed out or one failed to start.
+  // last_sample is set if the item is the last of its task.
+  i64 next_task(const StartTask& start_task, bool& last_sample);
+
+  // Starts no further tasks
+  void stop();
+
+  const std::vector<i64>& task_order() const { return task_order_; }
+
+  i64 tasks_started() const { return next_task_; }
+
+ private:
+  struct ActiveTask {
+    i64 task;
+    i64 samples_left;
+  };
+
+  std::vector<i64> task_order_;
+  // Position in task_order_ of the next task to start
+  i64 next_task_ = 0;
+  // Tasks items are handed out from in turn
+  std::vector<ActiveTask> active_tasks_;
+  size_t next_active_task_ = 0;
+  size_t max_active_tasks_ = 1;
+};
+
+}
+}
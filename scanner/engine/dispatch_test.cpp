@@ -0,0 +1,89 @@
+/* Copyright 2016 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/engine/dispatch.h"
+
+#include <gtest/gtest.h>
+
+namespace scanner {
+namespace internal {
+namespace {
+// Hands out every item of a job whose tasks have the given number of samples
+// and returns the task of each item in turn
+std::vector<i64> dispatch_all(TaskDispatcher& dispatcher,
+                              const std::vector<i64>& task_samples,
+                              std::vector<i64>* started = nullptr) {
+  std::vector<i64> tasks;
+  std::vector<i64> samples_left(task_samples.size(), -1);
+  auto start = [&](i64 task) {
+    if (started != nullptr) {
+      started->push_back(task);
+    }
+    samples_left[task] = task_samples[task];
+    return task_samples[task];
+  };
+  bool last_sample;
+  i64 task;
+  while ((task = dispatcher.next_task(start, last_sample)) != -1) {
+    tasks.push_back(task);
+    samples_left[task]--;
+    EXPECT_EQ(last_sample, samples_left[task] == 0);
+  }
+  return tasks;
+}
+}
+
+TEST(TaskDispatcher, InOrderRunsTasksOneAfterAnother) {
+  TaskDispatcher dispatcher(proto::InOrder, {3, 1, 2}, 4);
+  EXPECT_EQ(dispatch_all(dispatcher, {2, 1, 2}),
+            std::vector<i64>({0, 0, 1, 2, 2}));
+  EXPECT_EQ(dispatcher.tasks_started(), 3);
+}
+
+TEST(TaskDispatcher, LongestFirstStartsTasksWithMostRowsFirst) {
+  TaskDispatcher dispatcher(proto::LongestFirst, {10, 30, 20, 30}, 4);
+  // Tasks with the same number of rows keep their order
+  EXPECT_EQ(dispatcher.task_order(), std::vector<i64>({1, 3, 2, 0}));
+  std::vector<i64> started;
+  EXPECT_EQ(dispatch_all(dispatcher, {1, 2, 1, 1}, &started),
+            std::vector<i64>({1, 1, 3, 2, 0}));
+  EXPECT_EQ(started, std::vector<i64>({1, 3, 2, 0}));
+}
+
+TEST(TaskDispatcher, InterleavedHandsOutItemsInTurn) {
+  // Up to two tasks run at once, and a finished task is replaced by the
+  // next one in line
+  TaskDispatcher dispatcher(proto::Interleaved, {3, 1, 2}, 2);
+  std::vector<i64> started;
+  EXPECT_EQ(dispatch_all(dispatcher, {3, 1, 2}, &started),
+            std::vector<i64>({0, 1, 2, 0, 2, 0}));
+  EXPECT_EQ(started, std::vector<i64>({0, 1, 2}));
+}
+
+TEST(TaskDispatcher, SkipsTasksWithoutSamples) {
+  TaskDispatcher dispatcher(proto::Interleaved, {0, 2, 0}, 2);
+  EXPECT_EQ(dispatch_all(dispatcher, {0, 2, 0}), std::vector<i64>({1, 1}));
+  EXPECT_EQ(dispatcher.tasks_started(), 3);
+}
+
+TEST(TaskDispatcher, StopsWhenATaskFailsToStart) {
+  TaskDispatcher dispatcher(proto::Interleaved, {1, 1, 1}, 2);
+  auto start = [](i64 task) -> i64 { return task == 1 ? -1 : 2; };
+  bool last_sample;
+  EXPECT_EQ(dispatcher.next_task(start, last_sample), -1);
+  EXPECT_EQ(dispatcher.next_task(start, last_sample), -1);
+}
+}
+}
@@ -3,8 +3,7 @@
 #include "scanner/engine/op_registry.h"
 #include "scanner/video/decoder_automata.h"
 
-#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
-#include <google/protobuf/io/coded_stream.h>
+#include <future>
 #include <thread>
 
 namespace scanner {
@@ -47,6 +46,280 @@ void move_if_different_address_space(Profiler &profiler,
     }
   }
 }
+
+// Removes the first count valid frames from videos along with any intervals
+// which are left without valid frames
+void drop_valid_frames(std::vector<EncodedVideo> &videos, i64 count) {
+  while (count > 0) {
+    proto::DecodeArgs &da = videos.front().args;
+    if (da.valid_frames_size() <= count) {
+      count -= da.valid_frames_size();
+      videos.erase(videos.begin());
+      continue;
+    }
+    std::vector<i64> remaining(da.valid_frames().begin() + count,
+                               da.valid_frames().end());
+    da.clear_valid_frames();
+    for (i64 f : remaining) {
+      da.add_valid_frames(f);
+    }
+    count = 0;
+  }
+}
+
+// Decodes the frames of a video column through the frame cache. Returns a
+// block buffer holding the requested frames in order with one reference per
+// frame, or nullptr if the column should instead be decoded directly because
+// the frames it needs do not fit in the cache.
+u8 *decode_through_cache(Profiler &profiler, DecodedFrameCache &cache,
+                         DeviceHandle device, DecoderAutomata &decoder,
+                         std::vector<EncodedVideo> &videos) {
+  size_t frame_size = decoded_frame_size(videos[0].args);
+  auto key = [](const proto::DecodeArgs &da, i64 frame) {
+    return DecodedFrameCache::Key{da.table_id(), da.column_id(), da.item_id(),
+                                  frame};
+  };
+
+  i64 requested_frames = 0;
+  for (const EncodedVideo &video : videos) {
+    requested_frames += video.args.valid_frames_size();
+  }
+
+  std::vector<std::shared_ptr<const DecodedFrameCache::Frame>> frames;
+  for (const EncodedVideo &video : videos) {
+    const proto::DecodeArgs &da = video.args;
+    for (i64 f : da.valid_frames()) {
+      std::shared_ptr<const DecodedFrameCache::Frame> frame =
+          cache.lookup(key(da, f));
+      if (!frame) {
+        break;
+      }
+      frames.push_back(frame);
+    }
+    if ((i64)frames.size() < requested_frames) {
+      break;
+    }
+  }
+  if ((i64)frames.size() == requested_frames) {
+    profiler.increment("frame_cache_hits", requested_frames);
+    u8 *buffer =
+        new_block_buffer(device, requested_frames * frame_size,
+                         requested_frames);
+    for (i64 n = 0; n < requested_frames; ++n) {
+      memcpy_buffer(buffer + frame_size * n, device, frames[n]->buffer,
+                    frames[n]->device, frame_size);
+    }
+    return buffer;
+  }
+  frames.clear();
+
+  // Contiguous requests, such as those of stencils, also keep the frames
+  // following the last one, which neighbouring samples are likely to request
+  // next. Sparse requests are left as they are so that the decoder can skip
+  // the frames in between. Frames in flight are limited to a fraction of the
+  // cache so they do not evict each other.
+  i64 max_frames = cache.capacity() / 4 / frame_size;
+  if (requested_frames > max_frames) {
+    return nullptr;
+  }
+
+  // The read ahead frames only extend the last video, so the requested frames
+  // come first in decode order and are handed on in place
+  i64 total_frames = requested_frames;
+  EncodedVideo &last_video = videos.back();
+  proto::DecodeArgs &last_da = last_video.args;
+  i64 first = last_da.valid_frames(0);
+  i64 last = last_da.valid_frames(last_da.valid_frames_size() - 1);
+  if (last - first + 1 == last_da.valid_frames_size()) {
+    i64 readahead_last = std::min(last_da.end_keyframe() - 1,
+                                  last + max_frames - requested_frames);
+    for (i64 f = last + 1; f <= readahead_last; ++f) {
+      last_da.add_valid_frames(f);
+    }
+    total_frames += std::max(readahead_last - last, (i64)0);
+  }
+
+  u8 *decoded =
+      new_block_buffer(device, total_frames * frame_size, requested_frames);
+  decoder.initialize(videos);
+  decoder.get_frames(decoded, total_frames);
+  profiler.increment("frame_cache_misses", total_frames);
+
+  i64 n = 0;
+  for (const EncodedVideo &video : videos) {
+    for (i64 f : video.args.valid_frames()) {
+      cache.insert(key(video.args, f), decoded + frame_size * n, device,
+                   frame_size);
+      n++;
+    }
+  }
+  return decoded;
+}
+
+// Upper bound on the decoders each video column is spread across
+const i32 MAX_DECODERS_PER_COLUMN = 8;
+
+// Threads of a pre-evaluate thread which run its decode tasks. There is one
+// thread per decoder, so every task of an item runs concurrently and a task
+// blocked on handing out its frames never holds up another.
+class DecodeThreadPool {
+ public:
+  using Task = std::packaged_task<void()>;
+
+  DecodeThreadPool(i32 num_threads) : tasks_(std::max(num_threads, 1)) {
+    for (i32 i = 0; i < num_threads; ++i) {
+      threads_.emplace_back(&DecodeThreadPool::run, this);
+    }
+  }
+
+  ~DecodeThreadPool() {
+    // An empty task tells a thread to exit
+    for (size_t i = 0; i < threads_.size(); ++i) {
+      tasks_.push(Task());
+    }
+    for (std::thread &thread : threads_) {
+      thread.join();
+    }
+  }
+
+  std::future<void> submit(std::function<void()> fn) {
+    Task task(std::move(fn));
+    std::future<void> future = task.get_future();
+    tasks_.push(std::move(task));
+    return future;
+  }
+
+ private:
+  void run() {
+    while (true) {
+      Task task;
+      tasks_.pop(task);
+      if (!task.valid()) {
+        break;
+      }
+      task();
+    }
+  }
+
+  BoundedQueue<Task> tasks_;
+  std::vector<std::thread> threads_;
+};
+
+// Decodes the frames of a contiguous run of the intervals of a video
+// column. Tasks given a thread pool decode their whole run ahead on one of
+// its threads, so that the runs of a column, and different columns, are
+// decoded concurrently instead of waiting for the consumer to reach them.
+// Other tasks decode each piece on the calling thread when it is requested.
+class DecodeTask {
+ public:
+  DecodeTask(DecoderAutomata *decoder, DeviceHandle device,
+             std::vector<EncodedVideo> videos, DecodeThreadPool *pool)
+    : decoder_(decoder), device_(device), videos_(std::move(videos)),
+      frame_size_(decoded_frame_size(videos_[0].args)),
+      frames_left_(count_frames(videos_)),
+      frames_to_hand_out_(frames_left_),
+      pieces_(std::max((i64)1, (frames_left_ + DECODE_PIECE_FRAMES - 1) /
+                                   DECODE_PIECE_FRAMES)) {
+    if (pool != nullptr) {
+      decoded_ = pool->submit([this]() {
+        decoder_->initialize(videos_);
+        while (frames_left_ > 0) {
+          std::tuple<u8 *, i64> piece;
+          decode_piece(DECODE_PIECE_FRAMES, piece);
+          pieces_.push(std::move(piece));
+        }
+      });
+    }
+  }
+
+  // True once every frame has been handed out
+  bool done() const { return frames_to_hand_out_ == 0; }
+
+  ~DecodeTask() {
+    // The queue holds every piece of the run, so the decoding thread never
+    // blocks on it and finishes even if pieces were left behind
+    if (decoded_.valid()) {
+      decoded_.wait();
+    }
+    std::tuple<u8 *, i64> piece;
+    while (pieces_.try_pop(piece)) {
+      for (i64 f = 0; f < std::get<1>(piece); ++f) {
+        delete_buffer(device_, std::get<0>(piece) + f * frame_size_);
+      }
+    }
+  }
+
+  // Returns a block of decoded frames with one reference per frame. Pieces
+  // of pooled tasks may hold fewer frames than max_frames.
+  std::tuple<u8 *, i64> next_piece(i64 max_frames) {
+    std::tuple<u8 *, i64> piece;
+    if (decoded_.valid()) {
+      pieces_.pop(piece);
+    } else {
+      if (!initialized_) {
+        decoder_->initialize(videos_);
+        initialized_ = true;
+      }
+      decode_piece(max_frames, piece);
+    }
+    frames_to_hand_out_ -= std::get<1>(piece);
+    return piece;
+  }
+
+ private:
+  static const i64 DECODE_PIECE_FRAMES = 8;
+
+  static i64 count_frames(const std::vector<EncodedVideo> &videos) {
+    i64 frames = 0;
+    for (const EncodedVideo &video : videos) {
+      frames += video.args.valid_frames_size();
+    }
+    return frames;
+  }
+
+  void decode_piece(i64 max_frames, std::tuple<u8 *, i64> &piece) {
+    i64 num_frames = std::min(max_frames, frames_left_);
+    u8 *buffer =
+        new_block_buffer(device_, num_frames * frame_size_, num_frames);
+    decoder_->get_frames(buffer, num_frames);
+    frames_left_ -= num_frames;
+    piece = std::make_tuple(buffer, num_frames);
+  }
+
+  DecoderAutomata *decoder_;
+  DeviceHandle device_;
+  std::vector<EncodedVideo> videos_;
+  size_t frame_size_;
+  // Frames not yet decoded
+  i64 frames_left_;
+  i64 frames_to_hand_out_;
+  bool initialized_ = false;
+  BoundedQueue<std::tuple<u8 *, i64>> pieces_;
+  // Completes once a pooled task has decoded all of its frames
+  std::future<void> decoded_;
+};
+
+// Splits videos into at most max_groups contiguous runs with a similar
+// number of valid frames
+std::vector<std::vector<EncodedVideo>> split_encoded_videos(
+    std::vector<EncodedVideo> &videos, i32 max_groups) {
+  i64 total_frames = 0;
+  for (const EncodedVideo &video : videos) {
+    total_frames += video.args.valid_frames_size();
+  }
+  i32 num_groups = std::min(max_groups, (i32)videos.size());
+  std::vector<std::vector<EncodedVideo>> groups(1);
+  i64 frames = 0;
+  for (EncodedVideo &video : videos) {
+    if (!groups.back().empty() &&
+        frames >= total_frames * (i64)groups.size() / num_groups) {
+      groups.emplace_back();
+    }
+    frames += video.args.valid_frames_size();
+    groups.back().push_back(std::move(video));
+  }
+  return groups;
+}
 }
 
 void move_if_different_address_space(Profiler &profiler,
@@ -64,13 +337,23 @@ void *pre_evaluate_thread(void *arg) {
   PreEvaluateThreadArgs &args = *reinterpret_cast<PreEvaluateThreadArgs *>(arg);
 
   i64 work_item_size = args.job_params->work_item_size();
+  Profiler &profiler = args.profiler;
+  DecodedFrameCache *frame_cache = args.frame_cache;
 
   i32 last_table_id = -1;
-  i32 last_end_row = -1;
-  i32 last_item_id = -1;
+  i32 last_input_table_id = -1;
+  i64 last_next_input_row = -1;
 
   DeviceHandle decoder_output_handle;
-  std::vector<std::unique_ptr<DecoderAutomata>> decoders;
+  // Pool of decoders for each video column. The intervals of a column are
+  // spread across its pool and decoded concurrently.
+  std::vector<std::vector<std::unique_ptr<DecoderAutomata>>> decoders;
+  // Threads the decoders run on, kept across items. Null if every task
+  // decodes on this thread.
+  std::unique_ptr<DecodeThreadPool> decode_pool;
+  // Decoder of each column which was given the last interval of the previous
+  // item, so that a continuing item can resume with it
+  std::vector<i32> last_decoder;
   while (true) {
     auto idle_start = now();
     // Wait for next work item to process
@@ -90,19 +373,31 @@ void *pre_evaluate_thread(void *arg) {
 
     auto work_start = now();
 
+    // An item whose input rows follow on from those of the previous item of
+    // this pipeline continues from the state the kernels and decoders are
+    // already in, so the kernels are not reset and the warmup rows they have
+    // already seen are dropped. Output rows can not tell, since they are
+    // contiguous even when samples overlap or skip input rows.
     bool needs_configure = !(io_item.table_id() == last_table_id);
-    bool needs_reset = true;
-    // NOTE(apoms): for avoiding warmup
-    // needs_configure || !(io_item.item_id() == last_item_id ||
-    //       (io_item.table_id() == last_table_id &&
-    //        io_item.start_row() == last_end_row));
+    bool needs_reset =
+        needs_configure || work_entry.first_input_row < 0 ||
+        !(work_entry.input_table_id == last_input_table_id) ||
+        !(work_entry.first_input_row == last_next_input_row);
 
     last_table_id = io_item.table_id();
-    last_end_row = io_item.end_row();
-    last_item_id = io_item.item_id();
-
-    // Split up a work entry into work item size chunks
-    i64 total_rows = io_item.end_row() - io_item.start_row();
+    last_input_table_id = work_entry.input_table_id;
+    last_next_input_row = work_entry.next_input_row;
+
+    // Split up a work entry into work item size chunks. The entry holds the
+    // warmup rows for the item followed by the rows that are kept.
+    i64 warmup_rows = work_entry.warmup_rows;
+    i64 skipped_warmup_rows = 0;
+    if (!needs_reset) {
+      skipped_warmup_rows = warmup_rows;
+      warmup_rows = 0;
+      profiler.increment("skipped_warmup_rows", skipped_warmup_rows);
+    }
+    i64 total_rows = warmup_rows + io_item.end_row() - io_item.start_row();
 
     if (needs_configure) {
       //decoders.clear();
@@ -126,41 +421,91 @@ void *pre_evaluate_thread(void *arg) {
         decoder_type = VideoDecoderType::SOFTWARE;
         num_devices = args.num_cpus;
       }
+      i32 num_video_columns = 0;
       for (size_t c = 0; c < work_entry.columns.size(); ++c) {
         if (work_entry.column_types[c] == ColumnType::Video) {
-          decoders.emplace_back(new DecoderAutomata(args.device_handle,
-                                                    num_devices, decoder_type));
+          num_video_columns++;
         }
       }
+      // Software decoders split the cores between them instead of relying on
+      // the decoder's own threading, which scales poorly for small frames
+      i32 pool_size = 1;
+      if (decoder_type == VideoDecoderType::SOFTWARE) {
+        i32 num_columns = std::max(1, num_video_columns);
+        pool_size = std::max(1, std::min(MAX_DECODERS_PER_COLUMN,
+                                         args.num_cpus / num_columns));
+        num_devices = std::max(1, args.num_cpus / (pool_size * num_columns));
+        decode_pool.reset(
+            new DecodeThreadPool(pool_size * num_video_columns));
+      }
+      for (i32 i = 0; i < num_video_columns; ++i) {
+        decoders.emplace_back();
+        for (i32 d = 0; d < pool_size; ++d) {
+          decoders.back().emplace_back(new DecoderAutomata(
+              args.device_handle, num_devices, decoder_type));
+          decoders.back().back()->set_profiler(&args.profiler);
+        }
+        last_decoder.push_back(0);
+      }
       args.profiler.add_interval("init", init_start, now());
     }
 
     i32 media_col_idx = 0;
-    std::vector<std::vector<proto::DecodeArgs>> decode_args;
+    std::vector<std::vector<EncodedVideo>> encoded_videos;
+    // Frames of each video column which were decoded through the frame
+    // cache. Null if the column is decoded directly.
+    std::vector<u8 *> cached_frames;
+    // Decode tasks of each video column in row order
+    std::vector<std::vector<std::unique_ptr<DecodeTask>>> decode_tasks;
+    std::vector<size_t> frame_sizes;
     bool first_item = true;
     std::vector<EvalWorkEntry> work_items;
     auto setup_start = now();
     for (size_t c = 0; c < work_entry.columns.size(); ++c) {
       if (work_entry.column_types[c] == ColumnType::Video) {
-        decode_args.emplace_back();
-        auto &args = decode_args.back();
-        for (Row row : work_entry.columns[c].rows) {
-          args.emplace_back();
-          proto::DecodeArgs &da = args.back();
-          google::protobuf::io::ArrayInputStream in_stream(row.buffer,
-                                                           row.size);
-          google::protobuf::io::CodedInputStream cstream(&in_stream);
-          cstream.SetTotalBytesLimit(row.size * 2, row.size + 1);
-          da.ParseFromCodedStream(&cstream);
-          delete_buffer(CPU_DEVICE, row.buffer);
+        encoded_videos.emplace_back();
+        auto &videos = encoded_videos.back();
+        // The rows hand their buffers over to the decoders, which copy each
+        // packet out of the encoded data as they feed it
+        for (Row row : work_entry.take_column(c)) {
+          videos.push_back(parse_encoded_video_row(
+              work_entry.column_handles[c], row.buffer, row.size));
+        }
+        drop_valid_frames(videos, skipped_warmup_rows);
+        frame_sizes.push_back(decoded_frame_size(videos[0].args));
+        decode_tasks.emplace_back();
+        auto &pool = decoders[media_col_idx];
+        i32 &last = last_decoder[media_col_idx];
+        // The cache only pays off for items that restart decoding, such as
+        // overlapping samples. Continuing items resume the previous decoder.
+        cached_frames.push_back(
+            frame_cache != nullptr && needs_reset
+                ? decode_through_cache(profiler, *frame_cache,
+                                       decoder_output_handle, *pool[last],
+                                       videos)
+                : nullptr);
+        if (cached_frames.back() == nullptr) {
+          auto groups = split_encoded_videos(videos, (i32)pool.size());
+          for (size_t g = 0; g < groups.size(); ++g) {
+            DecoderAutomata *decoder = pool[(last + g) % pool.size()].get();
+            decode_tasks.back().emplace_back(
+                new DecodeTask(decoder, decoder_output_handle,
+                               std::move(groups[g]), decode_pool.get()));
+          }
+          last = (last + groups.size() - 1) % pool.size();
         }
-        decoders[media_col_idx]->initialize(args);
         media_col_idx++;
+      } else if (skipped_warmup_rows > 0) {
+        work_entry.erase_rows(c, 0, skipped_warmup_rows);
       }
     }
     args.profiler.add_interval("setup", setup_start, now());
 
     auto decode_start = now();
+    // Position of each video column in its decode tasks
+    std::vector<size_t> task_idx(decode_tasks.size(), 0);
+    std::vector<std::tuple<u8 *, i64>> pieces(decode_tasks.size(),
+                                              std::make_tuple(nullptr, 0));
     for (i64 r = 0; r < total_rows; r += work_item_size) {
       media_col_idx = 0;
       EvalWorkEntry entry;
@@ -168,6 +513,8 @@ void *pre_evaluate_thread(void *arg) {
       entry.needs_configure = first_item ? needs_configure : false;
       entry.needs_reset = first_item ? needs_reset : false;
       entry.last_in_io_item = (r + work_item_size >= total_rows) ? true : false;
+      entry.warmup_rows =
+          std::max((i64)0, std::min(warmup_rows - r, work_item_size));
       entry.columns.resize(work_entry.columns.size());
       for (size_t c = 0; c < work_entry.columns.size(); ++c) {
         i64 start = r;
@@ -175,25 +522,43 @@ void *pre_evaluate_thread(void *arg) {
         if (work_entry.column_types[c] == ColumnType::Video) {
           // Perform decoding
           i64 num_rows = end - start;
-          size_t frame_size = decode_args[media_col_idx][0].width() *
-                              decode_args[media_col_idx][0].height() * 3;
-          u8 *buffer = new_block_buffer(decoder_output_handle,
-                                        num_rows * frame_size, num_rows);
-          decoders[media_col_idx]->get_frames(buffer, num_rows);
-          for (i64 n = 0; n < num_rows; ++n) {
-            INSERT_ROW(entry.columns[c], buffer + frame_size * n, frame_size);
+          size_t frame_size = frame_sizes[media_col_idx];
+          u8 *frames = cached_frames[media_col_idx];
+          if (frames == nullptr) {
+            // Frames arrive in pieces from the tasks of the column in order
+            auto &tasks = decode_tasks[media_col_idx];
+            u8 *&piece_buffer = std::get<0>(pieces[media_col_idx]);
+            i64 &piece_frames = std::get<1>(pieces[media_col_idx]);
+            i64 rows_left = num_rows;
+            while (rows_left > 0) {
+              if (piece_frames == 0) {
+                size_t &t = task_idx[media_col_idx];
+                while (tasks[t]->done()) {
+                  t++;
+                }
+                std::tie(piece_buffer, piece_frames) =
+                    tasks[t]->next_piece(rows_left);
+              }
+              INSERT_ROW(entry.columns[c], piece_buffer, frame_size);
+              piece_buffer += frame_size;
+              piece_frames--;
+              rows_left--;
+            }
+          } else {
+            for (i64 n = start; n < end; ++n) {
+              INSERT_ROW(entry.columns[c], frames + frame_size * n,
+                         frame_size);
+            }
           }
           entry.column_handles.push_back(decoder_output_handle);
           media_col_idx++;
         } else {
-          entry.columns[c].rows =
-              std::vector<Row>(work_entry.columns[c].rows.begin() + start,
-                               work_entry.columns[c].rows.begin() + end);
           entry.column_handles.push_back(work_entry.column_handles[c]);
+          work_entry.move_rows(c, start, end, entry, c);
         }
       }
       // Push entry to kernels
-      args.output_work.push(std::make_tuple(io_item, entry));
+      args.output_work.push(std::make_tuple(io_item, std::move(entry)));
       first_item = false;
     }
     args.profiler.add_interval("decode", decode_start, now());
@@ -230,6 +595,7 @@ void *evaluate_thread(void *arg) {
       VLOG(1) << "Kernel finished validation " << args.result.success();
       if (!args.result.success()) {
         VLOG(1) << "Kernel validate failed: " << args.result.msg();
+        args.monitor.signal_error();
         THREAD_RETURN_SUCCESS();
       }
       kernels.emplace_back(kernel);
@@ -273,10 +639,9 @@ void *evaluate_thread(void *arg) {
     output_work_entry.needs_configure = work_entry.needs_configure;
     output_work_entry.needs_reset = work_entry.needs_reset;
     output_work_entry.last_in_io_item = work_entry.last_in_io_item;
+    output_work_entry.warmup_rows = work_entry.warmup_rows;
 
     BatchedColumns &work_item_output_columns = output_work_entry.columns;
-    std::vector<DeviceHandle> &work_item_output_handles =
-        output_work_entry.column_handles;
     i32 num_final_output_columns = 0;
 
     i32 current_input = 0;
@@ -289,22 +654,24 @@ void *evaluate_thread(void *arg) {
       i32 batch_size =
         std::min(total_inputs - current_input, args.job_params->work_item_size());
 
-      BatchedColumns side_input_columns;
       DeviceHandle input_handle;
       // Initialize the output buffers with the frame input because we
       // perform a swap from output to input on each iterator to pass outputs
-      // from the previous op into the input of the next one
-      std::vector<DeviceHandle> side_output_handles = work_entry.column_handles;
-      BatchedColumns side_output_columns;
+      // from the previous op into the input of the next one. The side entry
+      // takes ownership of the batch so anything left in it when an
+      // iteration ends, such as an intermediate column, gets freed.
+      EvalWorkEntry side_entry;
+      std::vector<DeviceHandle> &side_output_handles =
+          side_entry.column_handles;
+      BatchedColumns &side_output_columns = side_entry.columns;
+      side_output_handles = work_entry.column_handles;
       side_output_columns.resize(work_entry.columns.size());
       for (size_t i = 0; i < work_entry.columns.size(); ++i) {
         i32 batch =
             std::min(batch_size, (i32)work_entry.columns[i].rows.size());
         assert(batch > 0);
-        side_output_columns[i].rows.insert(
-            side_output_columns[i].rows.end(),
-            work_entry.columns[i].rows.begin() + current_input,
-            work_entry.columns[i].rows.begin() + current_input + batch);
+        work_entry.move_rows(i, current_input, current_input + batch,
+                             side_entry, i);
       }
       for (size_t k = 0; k < kernels.size(); ++k) {
         DeviceHandle current_handle = kernel_devices[k];
@@ -360,11 +727,7 @@ void *evaluate_thread(void *arg) {
         // Delete dead columns
         for (size_t y = 0; y < dead_columns[k].size(); ++y) {
           i32 dead_col_idx = dead_columns[k][dead_columns[k].size() - 1 - y];
-          RowList &column = side_output_columns[dead_col_idx];
-          for (Row &row : column.rows) {
-            u8 *buff = row.buffer;
-            delete_buffer(side_output_handles[dead_col_idx], buff);
-          }
+          side_entry.clear_column(dead_col_idx);
           side_output_columns.erase(side_output_columns.begin() + dead_col_idx);
           side_output_handles.erase(side_output_handles.begin() + dead_col_idx);
         }
@@ -377,16 +740,13 @@ void *evaluate_thread(void *arg) {
       if (work_item_output_columns.size() == 0) {
         num_final_output_columns = side_output_columns.size();
         work_item_output_columns.resize(side_output_columns.size());
-        work_item_output_handles = side_output_handles;
+        output_work_entry.column_handles = side_output_handles;
       }
       assert(num_final_output_columns == side_output_columns.size());
       for (i32 i = 0; i < num_final_output_columns; ++i) {
         i32 num_output_rows =
             static_cast<i32>(side_output_columns[i].rows.size());
-        work_item_output_columns[i].rows.insert(
-            work_item_output_columns[i].rows.end(),
-            side_output_columns[i].rows.begin(),
-            side_output_columns[i].rows.end());
+        side_entry.move_rows(i, 0, num_output_rows, output_work_entry, i);
       }
       current_input += batch_size;
     }
@@ -396,7 +756,8 @@ void *evaluate_thread(void *arg) {
     VLOG(1) << "Evaluate (N/KI/G: " << args.node_id << "/" << args.ki << "/"
               << args.kg << "): finished item " << work_entry.io_item_index;
 
-    args.output_work.push(std::make_tuple(io_item, output_work_entry));
+    args.output_work.push(
+        std::make_tuple(io_item, std::move(output_work_entry)));
   }
 
   VLOG(1) << "Evaluate (N/KI: " << args.node_id << "/" << args.ki
@@ -440,21 +801,15 @@ void *post_evaluate_thread(void *arg) {
     i32 warmup_frames = work_entry.warmup_rows;
     current_offset += num_rows;
     for (size_t i = 0; i < work_entry.columns.size(); ++i) {
-      // Delete warmup frame outputs
-      for (i32 w = 0; w < warmup_frames; ++w) {
-        delete_buffer(work_entry.column_handles[i],
-                      work_entry.columns[i].rows[w].buffer);
-      }
-      // Keep non-warmup frame outputs
-      buffered_entry.columns[i].rows.insert(
-          buffered_entry.columns[i].rows.end(),
-          work_entry.columns[i].rows.begin() + warmup_frames,
-          work_entry.columns[i].rows.end());
+      // Keep non-warmup frame outputs. Warmup frame outputs are still owned
+      // by the work entry and get freed along with it.
+      work_entry.move_rows(i, warmup_frames, num_rows, buffered_entry, i);
     }
 
     if (work_entry.last_in_io_item) {
-      args.output_work.push(std::make_tuple(io_item, buffered_entry));
-      buffered_entry.columns.clear();
+      args.output_work.push(
+          std::make_tuple(io_item, std::move(buffered_entry)));
+      buffered_entry = EvalWorkEntry();
     }
   }
 
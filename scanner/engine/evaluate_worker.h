@@ -17,8 +17,9 @@
 
 #include "scanner/engine/kernel_factory.h"
 #include "scanner/engine/runtime.h"
+#include "scanner/video/decoded_frame_cache.h"
 #include "scanner/util/common.h"
-#include "scanner/util/queue.h"
+#include "scanner/util/bounded_queue.h"
 
 namespace scanner {
 namespace internal {
@@ -41,9 +42,13 @@ struct PreEvaluateThreadArgs {
   DeviceHandle device_handle;
   Profiler& profiler;
 
+  // Decoded frames shared by the pre-evaluate threads of the node, nullptr if
+  // caching is disabled
+  DecodedFrameCache* frame_cache;
+
   // Queues for communicating work
-  Queue<std::tuple<IOItem, EvalWorkEntry>>& input_work;
-  Queue<std::tuple<IOItem, EvalWorkEntry>>& output_work;
+  BoundedQueue<std::tuple<IOItem, EvalWorkEntry>>& input_work;
+  BoundedQueue<std::tuple<IOItem, EvalWorkEntry>>& output_work;
 };
 
 struct EvaluateThreadArgs {
@@ -64,10 +69,11 @@ struct EvaluateThreadArgs {
   std::vector<std::vector<i32>> column_mapping;
   Profiler& profiler;
   proto::Result& result;
+  WorkerMonitor& monitor;
 
   // Queues for communicating work
-  Queue<std::tuple<IOItem, EvalWorkEntry>>& input_work;
-  Queue<std::tuple<IOItem, EvalWorkEntry>>& output_work;
+  BoundedQueue<std::tuple<IOItem, EvalWorkEntry>>& input_work;
+  BoundedQueue<std::tuple<IOItem, EvalWorkEntry>>& output_work;
 };
 
 struct PostEvaluateThreadArgs {
@@ -79,8 +85,8 @@ struct PostEvaluateThreadArgs {
   Profiler& profiler;
 
   // Queues for communicating work
-  Queue<std::tuple<IOItem, EvalWorkEntry>>& input_work;
-  Queue<std::tuple<IOItem, EvalWorkEntry>>& output_work;
+  BoundedQueue<std::tuple<IOItem, EvalWorkEntry>>& input_work;
+  BoundedQueue<std::tuple<IOItem, EvalWorkEntry>>& output_work;
 };
 
 void* pre_evaluate_thread(void* arg);
@@ -0,0 +1,228 @@
+/* Copyright 2016 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/api/kernel.h"
+#include "scanner/api/op.h"
+#include "scanner/engine/evaluate_worker.h"
+#include "scanner/engine/kernel_registry.h"
+#include "scanner/util/memory.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <thread>
+
+namespace scanner {
+namespace {
+class PassthroughKernel : public Kernel {
+ public:
+  PassthroughKernel(const Config &config) : Kernel(config) {}
+
+  void execute(const BatchedColumns &input_columns,
+               BatchedColumns &output_columns) override {
+    for (const Row &row : input_columns[0].rows) {
+      u8 *buffer = new_buffer(CPU_DEVICE, row.size);
+      std::memcpy(buffer, row.buffer, row.size);
+      output_columns[0].rows.push_back(Row{buffer, row.size});
+    }
+  }
+};
+
+REGISTER_OP(TestPassthrough).inputs({"x"}).outputs({"x"});
+
+REGISTER_KERNEL(TestPassthrough, PassthroughKernel)
+    .device(DeviceType::CPU)
+    .num_devices(1);
+}
+
+namespace internal {
+namespace {
+// Work entry of one io item as the load worker hands it on, with a single
+// column of the given input rows preceded by warmup_rows rows
+EvalWorkEntry input_entry(i64 first_input_row, i64 rows, i64 warmup_rows) {
+  EvalWorkEntry entry;
+  entry.columns.resize(1);
+  entry.column_handles = {CPU_DEVICE};
+  entry.column_types = {ColumnType::Other};
+  entry.warmup_rows = warmup_rows;
+  entry.input_table_id = 0;
+  entry.first_input_row = first_input_row;
+  entry.next_input_row = first_input_row + rows;
+  for (i64 r = first_input_row - warmup_rows; r < first_input_row + rows;
+       ++r) {
+    u8 *buffer = new_buffer(CPU_DEVICE, sizeof(i64));
+    std::memcpy(buffer, &r, sizeof(i64));
+    entry.columns[0].rows.push_back(Row{buffer, sizeof(i64)});
+  }
+  return entry;
+}
+}
+
+TEST(EvalWorkEntry, MoveRowsTransfersOwnership) {
+  init_memory_allocators(MemoryPoolConfig(), {});
+  {
+    EvalWorkEntry source;
+    source.columns.resize(1);
+    source.column_handles = {CPU_DEVICE};
+    u8 *block = new_block_buffer(CPU_DEVICE, 4 * 16, 4);
+    for (i64 r = 0; r < 4; ++r) {
+      source.columns[0].rows.push_back(Row{block + 16 * r, 16});
+    }
+    {
+      EvalWorkEntry dest;
+      dest.columns.resize(1);
+      dest.column_handles = {CPU_DEVICE};
+      source.move_rows(0, 1, 3, dest, 0);
+      EXPECT_EQ(dest.columns[0].rows.size(), 2);
+      EXPECT_EQ(dest.columns[0].rows[0].buffer, block + 16);
+    }
+    // The moved rows were freed with dest, the others are still owned here
+    EXPECT_EQ(block_stats(CPU_DEVICE).live_blocks, 1);
+    std::vector<Row> taken = source.take_column(0);
+    EXPECT_TRUE(source.columns[0].rows.empty());
+    delete_buffer(CPU_DEVICE, taken[0].buffer);
+    delete_buffer(CPU_DEVICE, taken[3].buffer);
+  }
+  EXPECT_EQ(block_stats(CPU_DEVICE).live_blocks, 0);
+  destroy_memory_allocators();
+}
+
+TEST(PreEvaluateWorker, ContinuesOnlyFollowingInputRows) {
+  init_memory_allocators(MemoryPoolConfig(), {});
+
+  proto::JobParameters job_params;
+  job_params.set_work_item_size(8);
+  Profiler profiler(now());
+  BoundedQueue<std::tuple<IOItem, EvalWorkEntry>> pre_work(4);
+  BoundedQueue<std::tuple<IOItem, EvalWorkEntry>> eval_work(4);
+  PreEvaluateThreadArgs args{0,        1,       &job_params, 0, CPU_DEVICE,
+                             profiler, nullptr, pre_work,    eval_work};
+
+  // Output rows are contiguous across all three items, but only the second
+  // item's input rows follow on from the previous item. The third overlaps
+  // it, as stencil samples do.
+  IOItem io_item;
+  io_item.set_table_id(0);
+  io_item.set_start_row(0);
+  io_item.set_end_row(2);
+  pre_work.push(std::make_tuple(io_item, input_entry(0, 2, 0)));
+  io_item.set_start_row(2);
+  io_item.set_end_row(4);
+  pre_work.push(std::make_tuple(io_item, input_entry(2, 2, 1)));
+  io_item.set_start_row(4);
+  io_item.set_end_row(6);
+  pre_work.push(std::make_tuple(io_item, input_entry(3, 2, 1)));
+  EvalWorkEntry stop;
+  stop.io_item_index = -1;
+  pre_work.push(std::make_tuple(IOItem(), std::move(stop)));
+
+  std::thread pre_evaluate([&]() { free(pre_evaluate_thread(&args)); });
+  pre_evaluate.join();
+
+  std::tuple<IOItem, EvalWorkEntry> output;
+  ASSERT_TRUE(eval_work.try_pop(output));
+  EXPECT_TRUE(std::get<1>(output).needs_reset);
+
+  // The kernels have already seen the warmup row, so it is dropped
+  ASSERT_TRUE(eval_work.try_pop(output));
+  EvalWorkEntry &continued = std::get<1>(output);
+  EXPECT_FALSE(continued.needs_reset);
+  EXPECT_EQ(continued.warmup_rows, 0);
+  EXPECT_EQ(continued.columns[0].rows.size(), 2);
+
+  ASSERT_TRUE(eval_work.try_pop(output));
+  EvalWorkEntry &overlapping = std::get<1>(output);
+  EXPECT_TRUE(overlapping.needs_reset);
+  EXPECT_EQ(overlapping.warmup_rows, 1);
+  EXPECT_EQ(overlapping.columns[0].rows.size(), 3);
+  overlapping.clear_column(0);
+  destroy_memory_allocators();
+}
+
+TEST(EvaluateWorker, WarmupRowsAreNotSaved) {
+  init_memory_allocators(MemoryPoolConfig(), {});
+
+  const i64 warmup_rows = 2;
+  const i64 rows = 3;
+  proto::JobParameters job_params;
+  job_params.set_work_item_size(4);
+  Profiler profiler(now());
+  proto::Result result;
+  result.set_success(true);
+  WorkerMonitor monitor;
+  BoundedQueue<std::tuple<IOItem, EvalWorkEntry>> eval_work(4);
+  BoundedQueue<std::tuple<IOItem, EvalWorkEntry>> post_work(4);
+  BoundedQueue<std::tuple<IOItem, EvalWorkEntry>> save_work(4);
+
+  Kernel::Config config;
+  config.devices = {CPU_DEVICE};
+  config.input_columns = {"x"};
+  config.output_columns = {"x"};
+  config.work_item_size = job_params.work_item_size();
+  EvaluateThreadArgs eval_args{
+      0, &job_params, 0, 0,
+      {std::make_tuple(
+          get_kernel_registry()->get_kernel("TestPassthrough", DeviceType::CPU),
+          config)},
+      {}, {{}}, {{}}, {{0}}, profiler, result, monitor, eval_work, post_work};
+  PostEvaluateThreadArgs post_args{0, 0, profiler, post_work, save_work};
+
+  // One work item holding the warmup rows and the rows of the io item, as
+  // pre-evaluate hands them on
+  IOItem io_item;
+  io_item.set_start_row(0);
+  io_item.set_end_row(rows);
+  EvalWorkEntry entry;
+  entry.columns.resize(1);
+  entry.column_handles = {CPU_DEVICE};
+  entry.column_types = {ColumnType::Other};
+  entry.needs_configure = true;
+  entry.needs_reset = true;
+  entry.last_in_io_item = true;
+  entry.warmup_rows = warmup_rows;
+  for (i64 r = 0; r < warmup_rows + rows; ++r) {
+    u8 *buffer = new_buffer(CPU_DEVICE, sizeof(i64));
+    std::memcpy(buffer, &r, sizeof(i64));
+    entry.columns[0].rows.push_back(Row{buffer, sizeof(i64)});
+  }
+  eval_work.push(std::make_tuple(io_item, std::move(entry)));
+  EvalWorkEntry stop;
+  stop.io_item_index = -1;
+  eval_work.push(std::make_tuple(IOItem(), std::move(stop)));
+
+  std::thread evaluate([&]() { free(evaluate_thread(&eval_args)); });
+  evaluate.join();
+  EvalWorkEntry post_stop;
+  post_stop.io_item_index = -1;
+  post_work.push(std::make_tuple(IOItem(), std::move(post_stop)));
+  std::thread post_evaluate([&]() { free(post_evaluate_thread(&post_args)); });
+  post_evaluate.join();
+
+  std::tuple<IOItem, EvalWorkEntry> output;
+  ASSERT_TRUE(save_work.try_pop(output));
+  EvalWorkEntry &saved = std::get<1>(output);
+  ASSERT_EQ(saved.columns.size(), 1);
+  // Only the rows of the io item are saved, starting after the warmup
+  ASSERT_EQ(saved.columns[0].rows.size(), rows);
+  for (i64 r = 0; r < rows; ++r) {
+    i64 value;
+    std::memcpy(&value, saved.columns[0].rows[r].buffer, sizeof(i64));
+    EXPECT_EQ(value, warmup_rows + r);
+  }
+  saved.clear_column(0);
+  destroy_memory_allocators();
+}
+}
+}
@@ -37,6 +37,7 @@ extern "C" {
 #include "libswscale/swscale.h"
 }
 
+#include <algorithm>
 #include <cassert>
 #include <fstream>
 
@@ -197,6 +198,97 @@ void cleanup_video_codec(CodecState state) {
   av_bitstream_filter_close(state.annexb);
 }
 
+// Works out the display order of the pictures between IDR frames from their
+// picture order counts so that the decoder can tell which frames it is free
+// to skip. Only frame pictures with picture order count type 0 or 2 are
+// understood; anything else disables tracking and every frame is decoded.
+class PictureOrderTracker {
+ public:
+  void add_picture(i64 packet, const SPS &sps, const SliceHeader &sh) {
+    if (!enabled_) {
+      return;
+    }
+    if (sh.field_pic_flag || sps.poc_type == 1) {
+      enabled_ = false;
+      gop_.clear();
+      non_reference_frames_.clear();
+      non_reference_packets_.clear();
+      return;
+    }
+    if (sh.nal_unit_type == 5) {
+      end_gop();
+      gop_start_ = packet;
+      prev_poc_msb_ = 0;
+      prev_poc_lsb_ = 0;
+    }
+    if (gop_start_ == -1) {
+      // Pictures before the first IDR frame can not be decoded on their own
+      return;
+    }
+
+    i64 poc;
+    if (sps.poc_type == 0) {
+      // Section 8.2.1.1 of the H.264 spec, without memory management
+      // control operations
+      i64 max_lsb = 1LL << sps.log2_max_pic_order_cnt_lsb;
+      i64 lsb = sh.pic_order_cnt_lsb;
+      i64 msb = prev_poc_msb_;
+      if (lsb < prev_poc_lsb_ && prev_poc_lsb_ - lsb >= max_lsb / 2) {
+        msb = prev_poc_msb_ + max_lsb;
+      } else if (lsb > prev_poc_lsb_ && lsb - prev_poc_lsb_ > max_lsb / 2) {
+        msb = prev_poc_msb_ - max_lsb;
+      }
+      poc = msb + lsb + std::min(sh.delta_pic_order_cnt_bottom, 0);
+      if (sh.nal_ref_idc != 0) {
+        prev_poc_msb_ = msb;
+        prev_poc_lsb_ = lsb;
+      }
+    } else {
+      poc = packet - gop_start_;
+    }
+    gop_.push_back(Picture{packet, poc, sh.nal_ref_idc != 0});
+  }
+
+  void finish() { end_gop(); }
+
+  const std::vector<i64> &non_reference_frames() const {
+    return non_reference_frames_;
+  }
+
+  const std::vector<i64> &non_reference_packets() const {
+    return non_reference_packets_;
+  }
+
+ private:
+  struct Picture {
+    i64 packet;
+    i64 poc;
+    bool reference;
+  };
+
+  void end_gop() {
+    std::stable_sort(gop_.begin(), gop_.end(),
+                     [](const Picture &a, const Picture &b) {
+                       return a.poc < b.poc;
+                     });
+    for (size_t i = 0; i < gop_.size(); ++i) {
+      if (!gop_[i].reference) {
+        non_reference_frames_.push_back(gop_start_ + i);
+        non_reference_packets_.push_back(gop_[i].packet);
+      }
+    }
+    gop_.clear();
+  }
+
+  bool enabled_ = true;
+  i64 gop_start_ = -1;
+  i64 prev_poc_msb_ = 0;
+  i64 prev_poc_lsb_ = 0;
+  std::vector<Picture> gop_;
+  std::vector<i64> non_reference_frames_;
+  std::vector<i64> non_reference_packets_;
+};
+
 bool parse_and_write_video(storehouse::StorageBackend *storage,
                            const std::string &table_name,
                            i32 table_id,
@@ -289,6 +381,7 @@ bool parse_and_write_video(storehouse::StorageBackend *storage,
 
   i32 num_non_ref_frames = 0;
   i32 avcodec_frame = 0;
+  PictureOrderTracker picture_order;
   while (true) {
     // Read from format context
     i32 err = av_read_frame(state.format_context, &state.av_packet);
@@ -471,6 +564,7 @@ bool parse_and_write_video(storehouse::StorageBackend *storage,
         }
         if (frame == 0 || is_new_access_unit(sps_map, pps_map, prev_sh, sh)) {
           frame++;
+          picture_order.add_picture(frame - 1, sps_map.at(last_sps), sh);
           size_t bytestream_offset;
           if (nal_unit_type == 5) {
             // Insert an SPS NAL if we did not see one in the meta packet
@@ -537,6 +631,13 @@ bool parse_and_write_video(storehouse::StorageBackend *storage,
   for (i64 v : keyframe_byte_offsets) {
     video_descriptor.add_keyframe_byte_offsets(v);
   }
+  picture_order.finish();
+  for (i64 v : picture_order.non_reference_frames()) {
+    video_descriptor.add_non_reference_frames(v);
+  }
+  for (i64 v : picture_order.non_reference_packets()) {
+    video_descriptor.add_non_reference_packets(v);
+  }
 
   // Save our metadata for the frame column
   write_video_metadata(storage, video_meta);
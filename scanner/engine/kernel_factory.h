@@ -39,9 +39,12 @@ class KernelFactory {
  public:
   KernelFactory(const std::string& op_name,
                 DeviceType type, i32 max_devices, i32 warmup_size,
+                const std::vector<FrameFormat>& frame_formats,
+                MaxFrameSizeFunction max_frame_size,
                 KernelConstructor constructor)
       : op_name_(op_name),
         type_(type), max_devices_(max_devices), warmup_size_(warmup_size),
+        frame_formats_(frame_formats), max_frame_size_(max_frame_size),
         constructor_(constructor) {}
 
   const std::string& get_op_name() const {
@@ -61,6 +64,21 @@ class KernelFactory {
     return warmup_size_;
   }
 
+  /** Frame formats the kernel accepts for video columns from a table. */
+  const std::vector<FrameFormat>& get_frame_formats() const {
+    return frame_formats_;
+  }
+
+  /** Whether the kernel declared the largest frames it needs. */
+  bool has_max_frame_size() const {
+    return static_cast<bool>(max_frame_size_);
+  }
+
+  /** Largest frame width and height the kernel needs, 0 if unbounded. */
+  std::tuple<i32, i32> get_max_frame_size(const Kernel::Config& config) const {
+    return max_frame_size_(config);
+  }
+
   /* @brief Constructs a kernel to be used for processing rows of data.
    */
   Kernel* new_instance(const Kernel::Config& config) {
@@ -72,6 +90,8 @@ class KernelFactory {
   DeviceType type_;
   i32 max_devices_;
   i32 warmup_size_;
+  std::vector<FrameFormat> frame_formats_;
+  MaxFrameSizeFunction max_frame_size_;
   KernelConstructor constructor_;
 };
 
@@ -15,13 +15,13 @@
 
 #include "scanner/engine/load_worker.h"
 #include "scanner/engine/sampling.h"
-
-#include "storehouse/storage_backend.h"
+#include "scanner/video/decoder_automata.h"
 
 #include <glog/logging.h>
 
-using storehouse::StoreResult;
-using storehouse::WriteFile;
+#include <algorithm>
+#include <deque>
+
 using storehouse::RandomReadFile;
 
 namespace scanner {
@@ -53,39 +53,58 @@ find_keyframe_indices(i32 start_frame, i32 end_frame,
 struct VideoIndexEntry {
   i32 width;
   i32 height;
-  std::unique_ptr<RandomReadFile> file;
+  // Owned by the metadata cache
+  RandomReadFile *file;
   u64 file_size;
   std::vector<i64> keyframe_positions;
   std::vector<i64> keyframe_byte_offsets;
+  std::vector<i64> non_reference_frames;
+  std::vector<i64> non_reference_packets;
 };
 
-VideoIndexEntry read_video_index(storehouse::StorageBackend *storage,
+VideoIndexEntry read_video_index(MetadataCache &cache, i32 worker_id,
                                  i32 table_id, i32 column_id, i32 item_id) {
   VideoIndexEntry index_entry;
-  VideoMetadata video_meta = read_video_metadata(
-      storage, VideoMetadata::descriptor_path(table_id, column_id, item_id));
-
-  // Open the video file for reading
-  index_entry.width = video_meta.width();
-  index_entry.height = video_meta.height();
-  BACKOFF_FAIL(storehouse::make_unique_random_read_file(
-      storage, table_item_output_path(table_id, column_id, item_id),
-      index_entry.file));
-  BACKOFF_FAIL(index_entry.file->get_size(index_entry.file_size));
-  index_entry.keyframe_positions = video_meta.keyframe_positions();
-  index_entry.keyframe_byte_offsets = video_meta.keyframe_byte_offsets();
+  std::shared_ptr<const VideoMetadata> video_meta =
+      cache.video_metadata(worker_id, table_id, column_id, item_id);
+
+  index_entry.width = video_meta->width();
+  index_entry.height = video_meta->height();
+  index_entry.file = cache.item_file(worker_id, table_id, column_id, item_id,
+                                     index_entry.file_size);
+  index_entry.keyframe_positions = video_meta->keyframe_positions();
+  index_entry.keyframe_byte_offsets = video_meta->keyframe_byte_offsets();
+  index_entry.non_reference_frames = video_meta->non_reference_frames();
+  index_entry.non_reference_packets = video_meta->non_reference_packets();
   // Place total frames at the end of keyframe positions and total file size
   // at the end of byte offsets to make interval calculation not need to
   // deal with edge cases surrounding those
-  index_entry.keyframe_positions.push_back(video_meta.frames());
+  index_entry.keyframe_positions.push_back(video_meta->frames());
   index_entry.keyframe_byte_offsets.push_back(index_entry.file_size);
 
   return index_entry;
 }
 
-void read_video_column(Profiler &profiler, VideoIndexEntry &index_entry,
-                       const std::vector<i64> &rows, RowList &row_list) {
-  RandomReadFile *video_file = index_entry.file.get();
+// Size and format of the frames the pre-evaluate stage decodes from a video
+FrameInfo output_frame_info(const LoadThreadArgs &args, i32 width,
+                            i32 height) {
+  FrameInfo frame_info;
+  frame_info.set_width(args.max_frame_width > 0
+                           ? std::min(width, args.max_frame_width)
+                           : width);
+  frame_info.set_height(args.max_frame_height > 0
+                            ? std::min(height, args.max_frame_height)
+                            : height);
+  frame_info.set_format(args.frame_format);
+  return frame_info;
+}
+
+// Returns the number of frames the decoder is expected to decode
+i64 read_video_column(Profiler &profiler, const FrameInfo &frame_info,
+                      i32 table_id, i32 column_id, i32 item_id,
+                      VideoIndexEntry &index_entry,
+                      const std::vector<i64> &rows, RowList &row_list) {
+  RandomReadFile *video_file = index_entry.file;
   u64 file_size = index_entry.file_size;
   const std::vector<i64> &keyframe_positions = index_entry.keyframe_positions;
   const std::vector<i64> &keyframe_byte_offsets =
@@ -96,8 +115,10 @@ void read_video_column(Profiler &profiler, VideoIndexEntry &index_entry,
   // the bytes starting at the iframe at or preceding the first frame
   // we are interested and will continue up to the bytes before the
   // iframe at or after the last frame we are interested in.
-  VideoIntervals intervals =
-      slice_into_video_intervals(keyframe_positions, rows);
+  VideoIntervals intervals = slice_into_video_intervals(
+      keyframe_positions, keyframe_byte_offsets, rows);
+  profiler.increment("planned_decoded_frames", intervals.decoded_frames);
+  profiler.increment("planned_used_frames", static_cast<i64>(rows.size()));
   size_t num_intervals = intervals.keyframe_index_intervals.size();
   for (size_t i = 0; i < num_intervals; ++i) {
     size_t start_keyframe_index;
@@ -124,15 +145,6 @@ void read_video_column(Profiler &profiler, VideoIndexEntry &index_entry,
     }
 
     size_t buffer_size = end_keyframe_byte_offset - start_keyframe_byte_offset;
-    u8 *buffer = new_buffer(CPU_DEVICE, buffer_size);
-
-    auto io_start = now();
-
-    u64 pos = start_keyframe_byte_offset;
-    s_read(video_file, buffer, buffer_size, pos);
-
-    profiler.add_interval("io", io_start, now());
-    profiler.increment("io_read", static_cast<i64>(buffer_size));
 
     proto::DecodeArgs decode_args;
     decode_args.set_width(index_entry.width);
@@ -148,70 +160,246 @@ void read_video_column(Profiler &profiler, VideoIndexEntry &index_entry,
     for (size_t j = 0; j < intervals.valid_frames[i].size(); ++j) {
       decode_args.add_valid_frames(intervals.valid_frames[i][j]);
     }
-    decode_args.set_encoded_video(buffer, buffer_size);
+    // Non-reference frames are sorted, so binary search for the interval
+    const std::vector<i64> &non_ref_frames = index_entry.non_reference_frames;
+    auto first_non_ref = std::lower_bound(
+        non_ref_frames.begin(), non_ref_frames.end(), start_keyframe);
+    auto last_non_ref = std::lower_bound(first_non_ref, non_ref_frames.end(),
+                                         end_keyframe);
+    for (auto it = first_non_ref; it != last_non_ref; ++it) {
+      decode_args.add_non_reference_frames(*it);
+      decode_args.add_non_reference_packets(
+          index_entry.non_reference_packets[it - non_ref_frames.begin()]);
+    }
+    decode_args.set_table_id(table_id);
+    decode_args.set_column_id(column_id);
+    decode_args.set_item_id(item_id);
+    decode_args.set_format(frame_info.format());
+    if (frame_info.width() != index_entry.width ||
+        frame_info.height() != index_entry.height) {
+      decode_args.set_output_width(frame_info.width());
+      decode_args.set_output_height(frame_info.height());
+    }
+
+    // The encoded bytes are read straight into the row after the decode args
+    // and are handed to the decoder from there without being copied
+    u8 *buffer;
+    size_t row_size;
+    u8 *row =
+        new_encoded_video_row(decode_args, buffer_size, buffer, row_size);
+
+    auto io_start = now();
+
+    u64 pos = start_keyframe_byte_offset;
+    s_read(video_file, buffer, buffer_size, pos);
 
-    size_t size = decode_args.ByteSize();
-    u8 *decode_args_buffer = new_buffer(CPU_DEVICE, size);
-    decode_args.SerializeToArray(decode_args_buffer, size);
-    INSERT_ROW(row_list, decode_args_buffer, size);
+    profiler.add_interval("io", io_start, now());
+    profiler.increment("io_read", static_cast<i64>(buffer_size));
 
-    delete_buffer(CPU_DEVICE, buffer);
+    INSERT_ROW(row_list, row, row_size);
   }
+  return intervals.decoded_frames;
 }
 
-void read_other_column(storehouse::StorageBackend *storage, i32 table_id,
-                       i32 column_id, i32 item_id, i32 item_start, i32 item_end,
-                       const std::vector<i64> &rows, RowList &row_list) {
+void read_other_column(MetadataCache &cache, i32 worker_id, i32 table_id,
+                       i32 column_id, i32 item_id, const std::vector<i64> &rows,
+                       RowList &row_list) {
   const std::vector<i64> &valid_offsets = rows;
+  if (valid_offsets.empty()) {
+    return;
+  }
+  i64 first_row = valid_offsets.front();
+  i64 last_row = valid_offsets.back();
+
+  // The column is either a file of its own or part of a table segment
+  MetadataCache::ColumnChunk chunk =
+      cache.column_chunk(worker_id, table_id, column_id, item_id);
+  RandomReadFile *file = chunk.file;
+
+  // A single read covers the header up to the end of the last requested row
+  // in either layout
+  u64 header_size =
+      std::min(chunk.size, static_cast<u64>(last_row + 4) * sizeof(u64));
+  std::vector<u64> header(header_size / sizeof(u64));
+  u64 pos = chunk.offset;
+  s_read(file, reinterpret_cast<u8 *>(header.data()), header_size, pos);
+
+  // Offsets of rows [0, last_row] relative to data_start
+  const u64 *row_offsets;
+  std::vector<u64> summed_offsets;
+  u64 data_start;
+  if (header[0] == COLUMN_FILE_MAGIC) {
+    u64 num_rows = header[1];
+    data_start = (num_rows + 3) * sizeof(u64);
+    row_offsets = header.data() + 2;
+  } else {
+    // Only row sizes are stored, so sum them up to the requested rows
+    u64 num_rows = header[0];
+    data_start = (num_rows + 1) * sizeof(u64);
+    summed_offsets.resize(last_row + 2);
+    summed_offsets[0] = 0;
+    for (i64 i = 0; i <= last_row; ++i) {
+      summed_offsets[i + 1] = summed_offsets[i] + header[i + 1];
+    }
+    row_offsets = summed_offsets.data();
+  }
 
-  std::unique_ptr<RandomReadFile> file;
-  StoreResult result;
-  BACKOFF_FAIL(make_unique_random_read_file(
-      storage, table_item_output_path(table_id, column_id, item_id), file));
-
-  u64 file_size = 0;
-  BACKOFF_FAIL(file->get_size(file_size));
+  // Read the requested rows into one block which the rows point into. The
+  // extra byte keeps empty rows at the end inside of the block.
+  u64 start_offset = row_offsets[first_row];
+  u64 data_size = row_offsets[last_row + 1] - start_offset;
+  u8 *block = new_block_buffer(CPU_DEVICE, data_size + 1,
+                               static_cast<i32>(valid_offsets.size()));
+  pos = chunk.offset + data_start + start_offset;
+  s_read(file, block, data_size, pos);
+
+  for (i64 row : valid_offsets) {
+    u8 *buffer = block + (row_offsets[row] - start_offset);
+    size_t buffer_size =
+        static_cast<size_t>(row_offsets[row + 1] - row_offsets[row]);
+    INSERT_ROW(row_list, buffer, buffer_size);
+  }
+}
 
-  // Read number of rows in file
-  u64 pos = 0;
-  u64 num_rows = s_read<u64>(file.get(), pos);
+// Reads the rows of an io item using the storage backend of a metadata cache
+// slot. Runs on the load worker itself or on a read ahead thread.
+void load_io_item(LoadThreadArgs &args, i32 slot,
+                  const LoadWorkEntry &load_work_entry,
+                  EvalWorkEntry &eval_work_entry) {
+  MetadataCache &cache = *args.metadata_cache;
+
+  auto work_start = now();
+
+  const auto &samples = load_work_entry.samples();
+
+  // Frames planned to be decoded and used across the video columns
+  i64 planned_decoded_frames = 0;
+  i64 planned_used_frames = 0;
+
+  eval_work_entry.io_item_index = load_work_entry.io_item_index();
+
+  // Aggregate all sample columns so we know the tuple size
+  assert(!samples.empty());
+  eval_work_entry.warmup_rows =
+      ranges_num_rows(ranges_from_proto(samples.Get(0).warmup_ranges()));
+  std::vector<RowRange> first_ranges =
+      ranges_from_proto(samples.Get(0).ranges());
+  if (!first_ranges.empty()) {
+    const RowRange &last_range = first_ranges.back();
+    eval_work_entry.input_table_id = samples.Get(0).table_id();
+    eval_work_entry.first_input_row = first_ranges.front().start;
+    eval_work_entry.next_input_row =
+        last_range.start + range_num_rows(last_range) * last_range.stride;
+  }
 
-  // Read row sizes from work item file header
-  std::vector<i64> row_sizes(num_rows);
-  s_read(file.get(), reinterpret_cast<u8 *>(row_sizes.data()),
-         row_sizes.size() * sizeof(i64), pos);
+  i32 num_columns = 0;
+  for (size_t i = 0; i < samples.size(); ++i) {
+    num_columns += samples.Get(i).column_ids_size();
+  }
+  eval_work_entry.columns.resize(num_columns);
+
+  i32 media_col_idx = 0;
+  i32 out_col_idx = 0;
+  for (const proto::LoadSample &sample : samples) {
+    i32 table_id = sample.table_id();
+    std::shared_ptr<const TableMetadata> table_meta_ptr =
+        cache.table_metadata(slot, table_id);
+    const TableMetadata &table_meta = *table_meta_ptr;
+
+    std::vector<RowRange> ranges = ranges_from_proto(sample.warmup_ranges());
+    std::vector<RowRange> sample_ranges = ranges_from_proto(sample.ranges());
+    ranges.insert(ranges.end(), sample_ranges.begin(), sample_ranges.end());
+    RowIntervals intervals = slice_into_row_intervals(table_meta, ranges);
+    size_t num_items = intervals.item_ids.size();
+    for (i32 col_id : sample.column_ids()) {
+      ColumnType column_type = ColumnType::Other;
+      if (table_meta.column_type(col_id) == ColumnType::Video) {
+        column_type = ColumnType::Video;
+        // video frame column
+        for (size_t i = 0; i < num_items; ++i) {
+          i32 item_id = intervals.item_ids[i];
+          const std::vector<i64> &valid_offsets = intervals.valid_offsets[i];
 
-  // Determine start and end position of rows to read in file
-  u64 start_offset = 0;
-  for (i64 i = 0; i < item_start; ++i) {
-    start_offset += row_sizes[i];
+          VideoIndexEntry entry =
+              read_video_index(cache, slot, table_id, col_id, item_id);
+          planned_decoded_frames += read_video_column(
+              args.profiler,
+              output_frame_info(args, entry.width, entry.height), table_id,
+              col_id, item_id, entry, valid_offsets,
+              eval_work_entry.columns[out_col_idx]);
+          planned_used_frames += valid_offsets.size();
+        }
+        media_col_idx++;
+      } else if (col_id > 0 &&
+                 // Convention is that frame info column is immediately
+                 // after frame column
+                 table_meta.column_type(col_id - 1) == ColumnType::Video) {
+        // video meta column
+        std::shared_ptr<const VideoMetadata> video_meta =
+            cache.video_metadata(slot, table_id, col_id - 1, 0);
+        proto::FrameInfo frame_info = output_frame_info(
+            args, video_meta->width(), video_meta->height());
+
+        size_t frame_info_size = frame_info.ByteSize();
+        for (size_t i = 0; i < num_items; ++i) {
+          size_t total_rows = intervals.valid_offsets[i].size();
+          u8 *buffer = new_block_buffer(
+              CPU_DEVICE, frame_info_size * total_rows, total_rows);
+          for (size_t j = 0; j < intervals.valid_offsets[i].size(); ++j) {
+            u8 *b = buffer + frame_info_size * j;
+            frame_info.SerializeToArray(b, frame_info_size);
+            INSERT_ROW(eval_work_entry.columns[out_col_idx], b,
+                       frame_info_size);
+          }
+        }
+      } else {
+        // regular column
+        for (size_t i = 0; i < num_items; ++i) {
+          i32 item_id = intervals.item_ids[i];
+          const std::vector<i64> &valid_offsets = intervals.valid_offsets[i];
+
+          read_other_column(cache, slot, table_id, col_id, item_id,
+                            valid_offsets,
+                            eval_work_entry.columns[out_col_idx]);
+        }
+      }
+      eval_work_entry.column_types.push_back(column_type);
+      eval_work_entry.column_handles.push_back(CPU_DEVICE);
+      out_col_idx++;
+    }
   }
-  u64 end_offset = start_offset;
-  for (i64 i = item_start; i < item_end; ++i) {
-    end_offset += row_sizes[i];
+
+  if (planned_used_frames > 0) {
+    VLOG(1) << "Load (N/PU: " << args.node_id << "/" << args.id
+            << "): item " << load_work_entry.io_item_index()
+            << " decode amplification "
+            << (f64)planned_decoded_frames / planned_used_frames << " ("
+            << planned_decoded_frames << " decoded for "
+            << planned_used_frames << " used)";
   }
-  u64 row_data_size = end_offset - start_offset;
-  std::vector<u8> row_data(row_data_size);
-
-  // Read chunk of file corresponding to requested rows
-  pos += start_offset;
-  s_read(file.get(), row_data.data(), row_data.size(), pos);
-
-  // Extract individual rows and insert into output work entry
-  u64 offset = 0;
-  size_t valid_idx = 0;
-  for (i32 i = item_start; i < item_end; ++i) {
-    size_t buffer_size = static_cast<size_t>(row_sizes[i]);
-    if (i == valid_offsets[valid_idx]) {
-      u8 *buffer = new_buffer(CPU_DEVICE, buffer_size);
-      memcpy(buffer, row_data.data() + offset, buffer_size);
-      INSERT_ROW(row_list, buffer, buffer_size);
-      valid_idx++;
+
+  args.profiler.add_interval("task", work_start, now());
+}
+
+// Total size of the rows read for an io item
+i64 eval_work_entry_bytes(const EvalWorkEntry &entry) {
+  i64 bytes = 0;
+  for (const RowList &column : entry.columns) {
+    for (const Row &row : column.rows) {
+      bytes += row.size;
     }
-    offset += buffer_size;
   }
-  assert(valid_idx == valid_offsets.size());
+  return bytes;
 }
+
+struct PendingItem {
+  IOItem io_item;
+  LoadWorkEntry load_work_entry;
+  EvalWorkEntry eval_work_entry;
+  // Set when the item is read ahead
+  std::future<void> read;
+  i64 bytes = 0;
+};
 }
 
 void *load_thread(void *arg) {
@@ -219,151 +407,76 @@ void *load_thread(void *arg) {
 
   auto setup_start = now();
 
-  const i32 work_item_size = args.job_params->work_item_size();
-
-  // Setup a distinct storage backend for each IO thread
-  storehouse::StorageBackend *storage =
-      storehouse::StorageBackend::make_from_config(args.storage_config);
-
-  // Caching table metadata
-  std::map<i32, TableMetadata> table_metadata;
-
-  // To ammortize opening files
-  i32 last_table_id = -1;
-  std::vector<VideoIndexEntry> index;
+  // Without a pool every item is read on this thread once it is next
+  ReadAheadPool *pool = args.read_ahead_pool;
+  const size_t prefetch_items =
+      pool != nullptr ? static_cast<size_t>(args.prefetch_items) : 0;
 
   args.profiler.add_interval("setup", setup_start, now());
+
+  // Items leased from the load queue in order, the oldest is handed on next
+  std::deque<std::unique_ptr<PendingItem>> pending;
+  bool finished = false;
   while (true) {
     auto idle_start = now();
 
-    std::tuple<IOItem, LoadWorkEntry> entry;
-    args.load_work.pop(entry);
-    IOItem& io_item = std::get<0>(entry);
-    LoadWorkEntry& load_work_entry = std::get<1>(entry);
+    // Lease further items to read ahead while within the budget. Only block
+    // on the load queue when there is nothing else to do.
+    while (!finished &&
+           (pending.empty() ||
+            (pending.size() <= prefetch_items &&
+             pool->held_bytes() < args.prefetch_bytes))) {
+      std::tuple<IOItem, LoadWorkEntry> entry;
+      if (pending.empty()) {
+        args.load_work.pop(entry);
+      } else if (!args.load_work.try_pop(entry)) {
+        break;
+      }
+      if (std::get<1>(entry).io_item_index() == -1) {
+        finished = true;
+        break;
+      }
 
-    if (load_work_entry.io_item_index() == -1) {
-      break;
+      std::unique_ptr<PendingItem> item(new PendingItem);
+      item->io_item = std::get<0>(entry);
+      item->load_work_entry = std::move(std::get<1>(entry));
+      if (prefetch_items > 0) {
+        PendingItem *p = item.get();
+        item->read = pool->submit([&args, pool, p](i32 slot) {
+          load_io_item(args, slot, p->load_work_entry, p->eval_work_entry);
+          p->bytes = eval_work_entry_bytes(p->eval_work_entry);
+          pool->hold(p->bytes);
+        });
+      }
+      pending.push_back(std::move(item));
     }
-
-    VLOG(1) << "Load (N/PU: " << args.node_id << "/" << args.id
-              << "): processing item " << load_work_entry.io_item_index();
-
-    args.profiler.add_interval("idle", idle_start, now());
-
-    auto work_start = now();
-
-    const auto &samples = load_work_entry.samples();
-
-    if (io_item.table_id() != last_table_id) {
-      // Not from the same task so clear cached data
-      last_table_id = io_item.table_id();
-      index.clear();
+    if (pending.empty()) {
+      break;
     }
 
-    EvalWorkEntry eval_work_entry;
-    eval_work_entry.io_item_index = load_work_entry.io_item_index();
+    std::unique_ptr<PendingItem> item = std::move(pending.front());
+    pending.pop_front();
 
-    // Aggregate all sample columns so we know the tuple size
-    assert(!samples.empty());
-    eval_work_entry.warmup_rows = samples.Get(0).warmup_rows_size();
-
-    i32 num_columns = 0;
-    for (size_t i = 0; i < samples.size(); ++i) {
-      num_columns += samples.Get(i).column_ids_size();
-    }
-    eval_work_entry.columns.resize(num_columns);
-
-    i32 media_col_idx = 0;
-    i32 out_col_idx = 0;
-    for (const proto::LoadSample &sample : samples) {
-      i32 table_id = sample.table_id();
-      auto it = table_metadata.find(table_id);
-      if (it == table_metadata.end()) {
-        table_metadata[table_id] = read_table_metadata(
-            storage, TableMetadata::descriptor_path(table_id));
-        it = table_metadata.find(table_id);
-      }
-      const TableMetadata &table_meta = it->second;
-
-      const google::protobuf::RepeatedField<i64> &sample_warmup_rows =
-          sample.warmup_rows();
-      const google::protobuf::RepeatedField<i64> &sample_rows = sample.rows();
-      std::vector<i64> rows(sample_warmup_rows.begin(),
-                            sample_warmup_rows.end());
-      rows.insert(rows.end(), sample_rows.begin(), sample_rows.end());
-      RowIntervals intervals = slice_into_row_intervals(table_meta, rows);
-      size_t num_items = intervals.item_ids.size();
-      for (i32 col_id : sample.column_ids()) {
-        ColumnType column_type = ColumnType::Other;
-        if (table_meta.column_type(col_id) == ColumnType::Video) {
-          column_type = ColumnType::Video;
-          // video frame column
-          for (size_t i = 0; i < num_items; ++i) {
-            i32 item_id = intervals.item_ids[i];
-            const std::vector<i64> &valid_offsets = intervals.valid_offsets[i];
-
-            // TODO(apoms): cache this so we avoid the IO and recompute for each
-            //   request
-            VideoIndexEntry entry =
-                read_video_index(storage, table_id, col_id, item_id);
-            read_video_column(args.profiler, entry, valid_offsets,
-                              eval_work_entry.columns[out_col_idx]);
-          }
-          media_col_idx++;
-        } else if (col_id > 0 &&
-                   // Convention is that frame info column is immediately
-                   // after frame column
-                   table_meta.column_type(col_id - 1) == ColumnType::Video) {
-          // video meta column
-          VideoIndexEntry entry =
-              read_video_index(storage, table_id, col_id - 1, 0);
-          proto::FrameInfo frame_info;
-          frame_info.set_width(entry.width);
-          frame_info.set_height(entry.height);
-
-          size_t frame_info_size = frame_info.ByteSize();
-          for (size_t i = 0; i < num_items; ++i) {
-            size_t total_rows = intervals.valid_offsets[i].size();
-            u8 *buffer = new_block_buffer(
-                CPU_DEVICE, frame_info_size * total_rows, total_rows);
-            for (size_t j = 0; j < intervals.valid_offsets[i].size(); ++j) {
-              u8 *b = buffer + frame_info_size * j;
-              frame_info.SerializeToArray(b, frame_info_size);
-              INSERT_ROW(eval_work_entry.columns[out_col_idx], b,
-                         frame_info_size);
-            }
-          }
-        } else {
-          // regular column
-          for (size_t i = 0; i < num_items; ++i) {
-            i32 item_id = intervals.item_ids[i];
-            i64 item_start;
-            i64 item_end;
-            std::tie(item_start, item_end) = intervals.item_intervals[i];
-            const std::vector<i64> &valid_offsets = intervals.valid_offsets[i];
-
-            read_other_column(storage, table_id, col_id, item_id, item_start,
-                              item_end, valid_offsets,
-                              eval_work_entry.columns[out_col_idx]);
-          }
-        }
-        eval_work_entry.column_types.push_back(column_type);
-        eval_work_entry.column_handles.push_back(CPU_DEVICE);
-        out_col_idx++;
-      }
+    VLOG(1) << "Load (N/PU: " << args.node_id << "/" << args.id
+            << "): processing item " << item->load_work_entry.io_item_index();
+
+    if (item->read.valid()) {
+      item->read.get();
+      pool->release(item->bytes);
+      args.profiler.add_interval("idle", idle_start, now());
+    } else {
+      args.profiler.add_interval("idle", idle_start, now());
+      load_io_item(args, args.id, item->load_work_entry,
+                   item->eval_work_entry);
     }
 
-    args.profiler.add_interval("task", work_start, now());
-
-    args.eval_work.push(std::make_tuple(io_item, eval_work_entry));
+    args.eval_work.push(
+        std::make_tuple(item->io_item, std::move(item->eval_work_entry)));
   }
 
   VLOG(1) << "Load (N/PU: " << args.node_id << "/" << args.id
             << "): thread finished";
 
-  // Cleanup
-  delete storage;
-
   THREAD_RETURN_SUCCESS();
 }
 }
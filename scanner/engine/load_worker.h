@@ -15,9 +15,11 @@
 
 #pragma once
 
+#include "scanner/engine/metadata_cache.h"
+#include "scanner/engine/read_ahead_pool.h"
 #include "scanner/engine/runtime.h"
 #include "scanner/util/common.h"
-#include "scanner/util/queue.h"
+#include "scanner/util/bounded_queue.h"
 
 namespace scanner {
 namespace internal {
@@ -26,15 +28,28 @@ struct LoadThreadArgs {
   // Uniform arguments
   i32 node_id;
   const proto::JobParameters* job_params;
+  // Format the pre-evaluate stage decodes video frames into
+  FrameFormat frame_format;
+  // Frames are shrunk while decoding to fit within this size, 0 leaves a
+  // dimension at full size
+  i32 max_frame_width;
+  i32 max_frame_height;
+  // Shared by the load workers of the node, id selects this worker's storage
+  MetadataCache* metadata_cache;
+  // Items are read ahead on this pool, nullptr reads them on the load worker
+  ReadAheadPool* read_ahead_pool;
+  // Io items read ahead of the one being handed on and the bytes of read
+  // items above which no further items are started
+  i32 prefetch_items;
+  i64 prefetch_bytes;
 
   // Per worker arguments
   int id;
-  storehouse::StorageConfig* storage_config;
   Profiler& profiler;
 
   // Queues for communicating work
-  Queue<std::tuple<IOItem, LoadWorkEntry>>& load_work;  // in
-  Queue<std::tuple<IOItem, EvalWorkEntry>>& eval_work;  // out
+  BoundedQueue<std::tuple<IOItem, LoadWorkEntry>>& load_work;  // in
+  BoundedQueue<std::tuple<IOItem, EvalWorkEntry>>& eval_work;  // out
 };
 
 void* load_thread(void* arg);
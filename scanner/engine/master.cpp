@@ -14,12 +14,17 @@
  */
 
 #include "scanner/engine/runtime.h"
+#include "scanner/engine/dispatch.h"
 #include "scanner/engine/ingest.h"
 #include "scanner/engine/sampler.h"
+#include "scanner/engine/table_segments.h"
 #include "scanner/util/progress_bar.h"
 #include <grpc/support/log.h>
 
+#include <algorithm>
+#include <atomic>
 #include <mutex>
+#include <thread>
 namespace scanner {
 namespace internal {
 namespace {
@@ -161,30 +166,6 @@ void validate_task_set(DatabaseMetadata &meta, const proto::TaskSet &task_set,
     }
   }
 }
-
-Result
-get_task_end_rows(const std::map<std::string, TableMetadata> &table_metas,
-                  const proto::Task &task, std::vector<i64> &rows) {
-  Result result;
-  result.set_success(true);
-
-  TaskSampler sampler(table_metas, task);
-  result = sampler.validate();
-  if (!result.success()) {
-    return result;
-  }
-  i64 num_samples = sampler.total_samples();
-  for (i64 i = 0; i < num_samples; ++i) {
-    proto::NewWork new_work;
-    result = sampler.next_work(new_work);
-    if (!result.success()) {
-      rows.clear();
-      return result;
-    }
-    rows.push_back(new_work.io_item().end_row());
-  }
-  return result;
-}
 }
 
 class MasterImpl final : public proto::Master::Service {
@@ -232,38 +213,30 @@ public:
                         const proto::NodeInfo *node_info,
                         proto::NewWork *new_work) {
     std::unique_lock<std::mutex> lk(work_mutex_);
-    if (samples_left_ <= 0) {
-      if (next_task_ < num_tasks_ && task_result_.success()) {
-        // More tasks left
-        task_sampler_.reset(new TaskSampler(
-            table_metas_, job_params_.task_set().tasks(next_task_)));
-        task_result_ = task_sampler_->validate();
-        if (task_result_.success()) {
-          samples_left_ = task_sampler_->total_samples();
-          next_task_++;
-          VLOG(1) << "Tasks left: " << num_tasks_ - next_task_;
-        }
-      } else {
-        // No more tasks left
-        new_work->mutable_io_item()->set_item_id(-1);
-        return grpc::Status::OK;
-      }
-    }
-    if (!task_result_.success()) {
-      new_work->mutable_io_item()->set_item_id(-1);
-      return grpc::Status::OK;
-    }
+    next_work(*new_work);
+    return grpc::Status::OK;
+  }
 
-    assert(samples_left_ > 0);
-    task_result_ = task_sampler_->next_work(*new_work);
-    if (!task_result_.success()) {
-      new_work->mutable_io_item()->set_item_id(-1);
-      return grpc::Status::OK;
+  grpc::Status NextWorkBatch(grpc::ServerContext *context,
+                             const proto::NodeInfo *node_info,
+                             proto::NewWorkBatch *batch) {
+    std::unique_lock<std::mutex> lk(work_mutex_);
+    // Cap the lease at an even share of the remaining samples so that a
+    // single node can not hoard the tail of the job
+    i64 num_workers = std::max((i64)1, (i64)workers_.size());
+    i64 lease_size = std::max((i64)1, (i64)node_info->max_items());
+    if (planning_done_) {
+      i64 samples_remaining = total_samples_ - total_samples_used_;
+      i64 fair_share = (samples_remaining + num_workers - 1) / num_workers;
+      lease_size = std::max((i64)1, std::min(lease_size, fair_share));
+    }
+    for (i64 i = 0; i < lease_size; ++i) {
+      proto::NewWork new_work;
+      if (!next_work(new_work)) {
+        break;
+      }
+      batch->add_work()->Swap(&new_work);
     }
-
-    samples_left_--;
-    total_samples_used_++;
-    bar_->Progressed(total_samples_used_);
     return grpc::Status::OK;
   }
 
@@ -327,15 +300,22 @@ public:
     job_descriptor.set_id(job_id);
     job_descriptor.set_name(job_params->job_name());
 
-    // Read all table metadata
-    for (const std::string &table_name : meta.table_names()) {
-      std::string table_path =
-          TableMetadata::descriptor_path(meta.get_table_id(table_name));
-      table_metas_[table_name] = read_table_metadata(storage_, table_path);
+    // Read the metadata of the tables the tasks sample from
+    table_metas_.clear();
+    for (auto &task : job_params->task_set().tasks()) {
+      for (auto &sample : task.samples()) {
+        const std::string &table_name = sample.table_name();
+        if (table_metas_.count(table_name) > 0) {
+          continue;
+        }
+        std::string table_path =
+            TableMetadata::descriptor_path(meta.get_table_id(table_name));
+        table_metas_[table_name] = read_table_metadata(storage_, table_path);
+      }
     }
 
-    total_samples_used_ = 0;
-    total_samples_ = 0;
+    // The output tables are only written once the job is known to be valid,
+    // but the task samplers already need their metadata
     for (auto &task : job_params->task_set().tasks()) {
       i32 table_id = meta.add_table(task.output_table_name());
       proto::TableDescriptor table_desc;
@@ -351,25 +331,29 @@ public:
         col->set_name(output_columns[i]);
         col->set_type(ColumnType::Other);
       }
-      table_metas_[task.output_table_name()] = TableMetadata(table_desc);
-      std::vector<i64> end_rows;
-      Result result = get_task_end_rows(table_metas_, task, end_rows);
-      if (!result.success()) {
-        *job_result = result;
-        break;
-      }
-      total_samples_ += end_rows.size();
-      for (i64 r : end_rows) {
-        table_desc.add_end_rows(r);
-      }
       table_desc.set_job_id(job_id);
-
-      write_table_metadata(storage_, TableMetadata(table_desc));
+      // End rows are filled in once the job is planned
       table_metas_[task.output_table_name()] = TableMetadata(table_desc);
     }
-    if (!job_result->success()) {
-      // No database changes made at this point, so just return
-      return grpc::Status::OK;
+
+    // Catch invalid samplers before any tables are written. Only the end rows
+    // are left to planning, whose errors are cleaned up after the job. The
+    // rows each task samples decide the order of LongestFirst jobs.
+    std::vector<i64> task_rows;
+    for (auto &task : job_params->task_set().tasks()) {
+      TaskSampler sampler(table_metas_, task);
+      Result valid = sampler.validate();
+      if (!valid.success()) {
+        // The database metadata is only written below, so the tables and job
+        // added to meta are simply dropped
+        job_result->CopyFrom(valid);
+        return grpc::Status::OK;
+      }
+      task_rows.push_back(sampler.total_rows());
+    }
+
+    for (auto &task : job_params->task_set().tasks()) {
+      write_table_metadata(storage_, table_metas_.at(task.output_table_name()));
     }
 
     // Write out database metadata so that workers can read it
@@ -377,9 +361,15 @@ public:
 
     // Setup initial task sampler
     task_result_.set_success(true);
-    samples_left_ = 0;
-    next_task_ = 0;
     num_tasks_ = job_params->task_set().tasks_size();
+    dispatcher_ = TaskDispatcher(job_params->dispatch_policy(), task_rows,
+                                 workers_.size());
+    task_samplers_.clear();
+    total_samples_used_ = 0;
+    total_samples_ = 0;
+    planning_done_ = false;
+    bar_ = nullptr;
+    task_end_rows_.assign(num_tasks_, std::vector<i64>());
 
     write_database_metadata(storage_, meta);
 
@@ -392,7 +382,8 @@ public:
     std::vector<std::unique_ptr<grpc::ClientAsyncResponseReader<proto::Result>>>
         rpcs;
 
-    bar_ = new ProgressBar(total_samples_, "");
+    // Work is handed out while later tasks are still being planned
+    std::thread planner(&MasterImpl::plan_tasks, this);
 
     std::map<std::string, i32> local_ids;
     std::map<std::string, i32> local_totals;
@@ -405,6 +396,10 @@ public:
 
     proto::JobParameters w_job_params;
     w_job_params.CopyFrom(*job_params);
+    for (auto &kv : table_metas_) {
+      w_job_params.add_table_descriptors()->CopyFrom(
+          kv.second.get_descriptor());
+    }
     for (size_t i = 0; i < workers_.size(); ++i) {
       auto &worker = workers_[i];
       std::string &address = addresses_[i];
@@ -430,18 +425,49 @@ public:
         LOG(WARNING) << "Worker returned error: " << replies[i].msg();
         job_result->set_success(false);
         job_result->set_msg(replies[i].msg());
-        next_task_ = num_tasks_;
+        std::unique_lock<std::mutex> lk(work_mutex_);
+        dispatcher_.stop();
       }
     }
 
-    if (!job_result->success()) {
-      // TODO(apoms): We wrote the db meta with the tables so we should clear
-      // them out here since the job failed.
+    planner.join();
+
+    // Output tables were written as segments by the save workers
+    std::map<i32, std::vector<proto::TableSegment>> table_segments;
+    for (const proto::Result &reply : replies) {
+      for (const proto::WrittenSegment &written : reply.segments()) {
+        table_segments[written.table_id()].push_back(written.segment());
+      }
+    }
+    for (i64 i = 0; i < num_tasks_; ++i) {
+      const std::string &table_name =
+          job_params->task_set().tasks(i).output_table_name();
+      proto::TableDescriptor table_desc =
+          table_metas_.at(table_name).get_descriptor();
+      for (i64 r : task_end_rows_[i]) {
+        table_desc.add_end_rows(r);
+      }
+      // Also moves the timestamp, so nodes drop the descriptor they were
+      // sent without end rows
+      record_table_segments(table_desc, table_segments[table_desc.id()]);
+      write_table_metadata(storage_, TableMetadata(table_desc));
+      table_metas_[table_name] = TableMetadata(table_desc);
+    }
+
+    if (!job_result->success() || !task_result_.success()) {
+      // The output tables were added to the database before the failure, so
+      // remove them along with the job rather than leave them half written
+      for (auto &task : job_params->task_set().tasks()) {
+        meta.remove_table(table_metas_.at(task.output_table_name()).id());
+        table_metas_.erase(task.output_table_name());
+      }
+      meta.remove_job(job_id);
+      write_database_metadata(storage_, meta);
     }
     if (!task_result_.success()) {
       job_result->CopyFrom(task_result_);
     } else {
-      assert(next_task_ == num_tasks_);
+      assert(dispatcher_.tasks_started() == num_tasks_);
       bar_->Progressed(total_samples_);
     }
 
@@ -481,6 +507,92 @@ public:
   }
 
 private:
+  // Fills in the next io item to process. Returns false and sets the item id
+  // to -1 if there is no more work or the current task failed to sample.
+  // Must be called with work_mutex_ held.
+  bool next_work(proto::NewWork &new_work) {
+    i64 task = -1;
+    bool last_sample = false;
+    if (task_result_.success()) {
+      task = dispatcher_.next_task(
+          [this](i64 t) -> i64 {
+            std::unique_ptr<TaskSampler> sampler(
+                new TaskSampler(table_metas_, job_params_.task_set().tasks(t)));
+            task_result_ = sampler->validate();
+            if (!task_result_.success()) {
+              return -1;
+            }
+            VLOG(1) << "Tasks left: "
+                    << num_tasks_ - dispatcher_.tasks_started() - 1;
+            i64 samples = sampler->total_samples();
+            if (samples > 0) {
+              task_samplers_[t] = std::move(sampler);
+            }
+            return samples;
+          },
+          last_sample);
+    }
+    if (task == -1) {
+      new_work.mutable_io_item()->set_item_id(-1);
+      return false;
+    }
+
+    task_result_ = task_samplers_.at(task)->next_work(new_work);
+    if (last_sample) {
+      task_samplers_.erase(task);
+    }
+    if (!task_result_.success()) {
+      new_work.mutable_io_item()->set_item_id(-1);
+      return false;
+    }
+
+    total_samples_used_++;
+    if (bar_ != nullptr) {
+      bar_->Progressed(total_samples_used_);
+    }
+    return true;
+  }
+
+  // Computes the end rows of the output table of each task. Tasks are
+  // planned in dispatch order on several threads so that the tasks handed
+  // out first are ready first. A task that fails to plan stops the job.
+  void plan_tasks() {
+    i64 num_threads = std::min(
+        (i64)std::max(std::thread::hardware_concurrency(), 1u), num_tasks_);
+    std::atomic<i64> next_task{0};
+    auto plan = [&]() {
+      i64 k;
+      while ((k = next_task++) < num_tasks_) {
+        i64 i = dispatcher_.task_order()[k];
+        TaskSampler sampler(table_metas_, job_params_.task_set().tasks(i));
+        std::vector<i64> end_rows;
+        Result result = sampler.end_rows(end_rows);
+
+        std::unique_lock<std::mutex> lk(work_mutex_);
+        if (!result.success()) {
+          if (task_result_.success()) {
+            task_result_ = result;
+          }
+          continue;
+        }
+        total_samples_ += end_rows.size();
+        task_end_rows_[i].swap(end_rows);
+      }
+    };
+    std::vector<std::thread> threads;
+    for (i64 t = 0; t < num_threads; ++t) {
+      threads.emplace_back(plan);
+    }
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+
+    std::unique_lock<std::mutex> lk(work_mutex_);
+    planning_done_ = true;
+    bar_ = new ProgressBar(total_samples_, "");
+    bar_->Progressed(total_samples_used_);
+  }
+
   std::vector<std::unique_ptr<proto::Worker::Stub>> workers_;
     std::vector<std::string> addresses_;
   DatabaseParameters db_params_;
@@ -491,12 +603,15 @@ private:
 
   i64 total_samples_used_;
   i64 total_samples_;
+  // Set by plan_tasks, under work_mutex_ while the job runs
+  bool planning_done_;
+  std::vector<std::vector<i64>> task_end_rows_;
 
   std::mutex work_mutex_;
-  i64 next_task_;
   i64 num_tasks_;
-  std::unique_ptr<TaskSampler> task_sampler_;
-  i64 samples_left_;
+  TaskDispatcher dispatcher_;
+  // Samplers of the tasks items are being handed out from
+  std::map<i64, std::unique_ptr<TaskSampler>> task_samplers_;
   Result task_result_;
 };
 
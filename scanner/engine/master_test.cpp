@@ -0,0 +1,218 @@
+/* Copyright 2016 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/api/kernel.h"
+#include "scanner/api/op.h"
+#include "scanner/engine/db.h"
+#include "scanner/engine/rpc.grpc.pb.h"
+#include "scanner/engine/runtime.h"
+#include "scanner/util/fs.h"
+
+#include <grpc++/security/server_credentials.h>
+#include <grpc++/server.h>
+#include <grpc++/server_builder.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstring>
+
+namespace scanner {
+namespace {
+class PassthroughKernel : public Kernel {
+ public:
+  PassthroughKernel(const Config &config) : Kernel(config) {}
+
+  void execute(const BatchedColumns &input_columns,
+               BatchedColumns &output_columns) override {
+    for (const Row &row : input_columns[0].rows) {
+      u8 *buffer = new_buffer(CPU_DEVICE, row.size);
+      std::memcpy(buffer, row.buffer, row.size);
+      output_columns[0].rows.push_back(Row{buffer, row.size});
+    }
+  }
+};
+
+REGISTER_OP(TestPassthrough).inputs({"x"}).outputs({"x"});
+
+REGISTER_KERNEL(TestPassthrough, PassthroughKernel)
+    .device(DeviceType::CPU)
+    .num_devices(1);
+}
+
+namespace internal {
+namespace {
+// Worker which takes io items from the master until there are none left
+// without processing them
+class PullingWorker final : public proto::Worker::Service {
+ public:
+  PullingWorker(proto::Master::Service *master) : master_(master) {}
+
+  grpc::Status NewJob(grpc::ServerContext *context,
+                      const proto::JobParameters *job_params,
+                      proto::Result *job_result) override {
+    proto::NodeInfo node_info;
+    while (true) {
+      proto::NewWork new_work;
+      master_->NextWork(nullptr, &node_info, &new_work);
+      if (new_work.io_item().item_id() == -1) {
+        break;
+      }
+      items_++;
+    }
+    job_result->set_success(true);
+    return grpc::Status::OK;
+  }
+
+  grpc::Status LoadOp(grpc::ServerContext *context,
+                      const proto::OpInfo *op_info,
+                      proto::Empty *empty) override {
+    return grpc::Status::OK;
+  }
+
+  i64 items() const { return items_; }
+
+ private:
+  proto::Master::Service *master_;
+  std::atomic<i64> items_{0};
+};
+
+class MasterTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    temp_dir(db_path_);
+    storage_config_.reset(storehouse::StorageConfig::make_posix_config());
+    storage_.reset(
+        storehouse::StorageBackend::make_from_config(storage_config_.get()));
+    set_database_path(db_path_);
+
+    // Database with a single table of 100 rows
+    DatabaseMetadata meta{};
+    proto::TableDescriptor table_desc;
+    table_desc.set_id(meta.add_table("input"));
+    table_desc.set_name("input");
+    Column *col = table_desc.add_columns();
+    col->set_id(0);
+    col->set_name("x");
+    col->set_type(ColumnType::Other);
+    table_desc.add_end_rows(100);
+    write_table_metadata(storage_.get(), TableMetadata(table_desc));
+    write_database_metadata(storage_.get(), meta);
+
+    DatabaseParameters params;
+    params.storage_config = storage_config_.get();
+    params.db_path = db_path_;
+    params.num_cpus = 1;
+    params.num_load_workers = 1;
+    params.num_save_workers = 1;
+    params.num_load_io_threads = 1;
+    master_.reset(get_master_service(params));
+
+    worker_.reset(new PullingWorker(master_.get()));
+    i32 port = 0;
+    grpc::ServerBuilder builder;
+    builder.AddListeningPort("localhost:0", grpc::InsecureServerCredentials(),
+                             &port);
+    builder.RegisterService(worker_.get());
+    worker_server_ = builder.BuildAndStart();
+    ASSERT_NE(worker_server_, nullptr);
+
+    proto::WorkerInfo worker_info;
+    worker_info.set_address("localhost:" + std::to_string(port));
+    proto::Registration registration;
+    master_->RegisterWorker(nullptr, &worker_info, &registration);
+  }
+
+  void TearDown() override {
+    worker_server_->Shutdown();
+    master_.reset();
+  }
+
+  // Job passing column x of the input table through to output, in samples
+  // of sample_size rows
+  proto::JobParameters passthrough_job(i64 sample_size) {
+    proto::JobParameters job_params;
+    job_params.set_job_name("passthrough");
+    job_params.set_io_item_size(10);
+    job_params.set_work_item_size(10);
+
+    proto::TaskSet *task_set = job_params.mutable_task_set();
+    proto::Task *task = task_set->add_tasks();
+    task->set_output_table_name("output");
+    proto::TableSample *sample = task->add_samples();
+    sample->set_table_name("input");
+    sample->add_column_names("x");
+    sample->set_sampling_function("All");
+    proto::AllSamplerArgs args;
+    args.set_sample_size(sample_size);
+    sample->set_sampling_args(args.SerializeAsString());
+
+    proto::Op *input = task_set->add_ops();
+    input->set_name("InputTable");
+    input->add_inputs()->add_columns("x");
+    proto::Op *passthrough = task_set->add_ops();
+    passthrough->set_name("TestPassthrough");
+    passthrough->set_device_type(DeviceType::CPU);
+    proto::OpInput *passthrough_input = passthrough->add_inputs();
+    passthrough_input->set_op_index(0);
+    passthrough_input->add_columns("x");
+    proto::Op *output = task_set->add_ops();
+    output->set_name("OutputTable");
+    proto::OpInput *output_input = output->add_inputs();
+    output_input->set_op_index(1);
+    output_input->add_columns("x");
+    return job_params;
+  }
+
+  std::string db_path_;
+  std::unique_ptr<storehouse::StorageConfig> storage_config_;
+  std::unique_ptr<storehouse::StorageBackend> storage_;
+  std::unique_ptr<proto::Master::Service> master_;
+  std::unique_ptr<PullingWorker> worker_;
+  std::unique_ptr<grpc::Server> worker_server_;
+};
+}
+
+TEST_F(MasterTest, RunsValidJob) {
+  proto::JobParameters job_params = passthrough_job(10);
+  proto::Result job_result;
+  master_->NewJob(nullptr, &job_params, &job_result);
+  ASSERT_TRUE(job_result.success()) << job_result.msg();
+  EXPECT_EQ(worker_->items(), 10);
+
+  DatabaseMetadata meta = read_database_metadata(
+      storage_.get(), DatabaseMetadata::descriptor_path());
+  ASSERT_TRUE(meta.has_table("output"));
+  i32 table_id = meta.get_table_id("output");
+  TableMetadata table = read_table_metadata(
+      storage_.get(), TableMetadata::descriptor_path(table_id));
+  EXPECT_EQ(table.num_rows(), 100);
+  EXPECT_EQ(table.end_rows().size(), 10);
+}
+
+TEST_F(MasterTest, InvalidSamplerWritesNothing) {
+  // The All sampler rejects empty samples
+  proto::JobParameters job_params = passthrough_job(0);
+  proto::Result job_result;
+  master_->NewJob(nullptr, &job_params, &job_result);
+  EXPECT_FALSE(job_result.success());
+  EXPECT_EQ(worker_->items(), 0);
+
+  DatabaseMetadata meta = read_database_metadata(
+      storage_.get(), DatabaseMetadata::descriptor_path());
+  EXPECT_FALSE(meta.has_table("output"));
+  EXPECT_FALSE(meta.has_job("passthrough"));
+}
+}
+}
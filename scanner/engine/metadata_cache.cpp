@@ -0,0 +1,209 @@
+/* Copyright 2016 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/engine/metadata_cache.h"
+
+#include <glog/logging.h>
+
+#include <limits>
+
+using storehouse::RandomReadFile;
+
+namespace scanner {
+namespace internal {
+
+MetadataCache::MetadataCache(storehouse::StorageConfig *config,
+                             i32 num_workers)
+    : workers_(num_workers) {
+  for (WorkerFiles &worker : workers_) {
+    worker.storage = storehouse::StorageBackend::make_from_config(config);
+  }
+}
+
+MetadataCache::~MetadataCache() {
+  for (WorkerFiles &worker : workers_) {
+    // Files have to be closed before the backend that opened them
+    worker.files.clear();
+    delete worker.storage;
+  }
+}
+
+void MetadataCache::update_tables(const std::vector<TableMetadata> &tables) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (const TableMetadata &table : tables) {
+    auto it = tables_.find(table.id());
+    if (it != tables_.end()) {
+      if (it->second->get_descriptor().timestamp() ==
+          table.get_descriptor().timestamp()) {
+        continue;
+      }
+      drop_table(table.id());
+    }
+    tables_[table.id()] = std::make_shared<TableMetadata>(table);
+  }
+}
+
+storehouse::StorageBackend *MetadataCache::storage(i32 worker_id) {
+  return workers_.at(worker_id).storage;
+}
+
+std::shared_ptr<const TableMetadata> MetadataCache::table_metadata(
+    i32 worker_id, i32 table_id) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = tables_.find(table_id);
+    if (it != tables_.end()) {
+      hits_++;
+      return it->second;
+    }
+  }
+  misses_++;
+
+  // Read outside of the lock so other workers are not held up by the IO
+  std::shared_ptr<const TableMetadata> meta =
+      std::make_shared<TableMetadata>(read_table_metadata(
+          storage(worker_id), TableMetadata::descriptor_path(table_id)));
+  std::unique_lock<std::mutex> lock(mutex_);
+  return tables_.insert({table_id, meta}).first->second;
+}
+
+std::shared_ptr<const VideoMetadata> MetadataCache::video_metadata(
+    i32 worker_id, i32 table_id, i32 column_id, i32 item_id) {
+  Key key(table_id, column_id, item_id);
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = videos_.find(key);
+    if (it != videos_.end()) {
+      hits_++;
+      return it->second;
+    }
+  }
+  misses_++;
+
+  std::shared_ptr<const VideoMetadata> meta =
+      std::make_shared<VideoMetadata>(read_video_metadata(
+          storage(worker_id),
+          VideoMetadata::descriptor_path(table_id, column_id, item_id)));
+  std::unique_lock<std::mutex> lock(mutex_);
+  return videos_.insert({key, meta}).first->second;
+}
+
+RandomReadFile *MetadataCache::item_file(i32 worker_id, i32 table_id,
+                                         i32 column_id, i32 item_id,
+                                         u64 &file_size) {
+  return open_file(worker_id, table_id,
+                   table_item_output_path(table_id, column_id, item_id),
+                   file_size);
+}
+
+MetadataCache::ColumnChunk MetadataCache::column_chunk(i32 worker_id,
+                                                       i32 table_id,
+                                                       i32 column_id,
+                                                       i32 item_id) {
+  ColumnChunk chunk;
+  std::string segment =
+      table_metadata(worker_id, table_id)->item_segment(item_id);
+  if (segment.empty()) {
+    chunk.file = item_file(worker_id, table_id, column_id, item_id, chunk.size);
+    chunk.offset = 0;
+    return chunk;
+  }
+
+  u64 file_size;
+  chunk.file = open_file(worker_id, table_id,
+                         table_segment_path(table_id, segment), file_size);
+  std::tuple<i32, std::string> key(table_id, segment);
+  std::shared_ptr<const SegmentIndex> index;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = segments_.find(key);
+    if (it != segments_.end()) {
+      hits_++;
+      index = it->second;
+    }
+  }
+  if (!index) {
+    misses_++;
+    index = std::make_shared<SegmentIndex>(
+        read_segment_index(chunk.file, file_size));
+    std::unique_lock<std::mutex> lock(mutex_);
+    index = segments_.insert({key, index}).first->second;
+  }
+
+  auto it = index->find(std::make_tuple((i64)item_id, (i64)column_id));
+  LOG_IF(FATAL, it == index->end())
+      << "Column " << column_id << " of item " << item_id << " missing from "
+      << "segment " << segment << " of table " << table_id;
+  std::tie(chunk.offset, chunk.size) = it->second;
+  return chunk;
+}
+
+RandomReadFile *MetadataCache::open_file(i32 worker_id, i32 table_id,
+                                         const std::string &path,
+                                         u64 &file_size) {
+  WorkerFiles &worker = workers_.at(worker_id);
+  auto it = worker.files.find(path);
+  if (it != worker.files.end()) {
+    hits_++;
+    worker.lru.splice(worker.lru.begin(), worker.lru, it->second.lru_it);
+    file_size = it->second.size;
+    return it->second.file.get();
+  }
+  misses_++;
+
+  OpenFile open_file;
+  open_file.table_id = table_id;
+  BACKOFF_FAIL(storehouse::make_unique_random_read_file(worker.storage, path,
+                                                        open_file.file));
+  BACKOFF_FAIL(open_file.file->get_size(open_file.size));
+
+  // Keep the number of open files bounded
+  while (worker.files.size() >= (size_t)MAX_OPEN_FILES_PER_LOAD_WORKER &&
+         !worker.lru.empty()) {
+    worker.files.erase(worker.lru.back());
+    worker.lru.pop_back();
+  }
+  worker.lru.push_front(path);
+  open_file.lru_it = worker.lru.begin();
+  file_size = open_file.size;
+  RandomReadFile *file = open_file.file.get();
+  worker.files[path] = std::move(open_file);
+  return file;
+}
+
+void MetadataCache::drop_table(i32 table_id) {
+  tables_.erase(table_id);
+  // Keys are ordered by table id first
+  Key first(table_id, std::numeric_limits<i32>::min(),
+            std::numeric_limits<i32>::min());
+  Key last(table_id, std::numeric_limits<i32>::max(),
+           std::numeric_limits<i32>::max());
+  videos_.erase(videos_.lower_bound(first), videos_.upper_bound(last));
+  segments_.erase(segments_.lower_bound(std::make_tuple(table_id, "")),
+                  segments_.lower_bound(std::make_tuple(table_id + 1, "")));
+  for (WorkerFiles &worker : workers_) {
+    for (auto it = worker.files.begin(); it != worker.files.end();) {
+      if (it->second.table_id == table_id) {
+        worker.lru.erase(it->second.lru_it);
+        it = worker.files.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+}
+
+}
+}
@@ -0,0 +1,123 @@
+/* Copyright 2016 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "scanner/engine/db.h"
+#include "scanner/engine/table_segments.h"
+#include "scanner/util/common.h"
+
+#include "storehouse/storage_backend.h"
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <tuple>
+
+namespace scanner {
+namespace internal {
+
+///////////////////////////////////////////////////////////////////////////////
+/// MetadataCache
+///
+/// Table and video metadata and open column files shared by the load workers
+/// of a node across io items and jobs. Each of these costs a round trip to the
+/// storage backend, which is tens of milliseconds on object stores.
+///
+/// Storage backends are not thread safe, so the cache keeps one backend per
+/// load worker and file handles are only handed back to the worker that
+/// opened them. Everything cached for a table is dropped once its timestamp
+/// changes, which jobs learn from the descriptors the master sends along.
+class MetadataCache {
+ public:
+  MetadataCache(storehouse::StorageConfig* config, i32 num_workers);
+  ~MetadataCache();
+
+  // Caches the given table metadata and drops the cached state of those
+  // tables that were rewritten since they were cached. Other tables are left
+  // alone as table ids are never reused. Must not be called while load
+  // workers are running.
+  void update_tables(const std::vector<TableMetadata>& tables);
+
+  // Storage backend reserved for load worker worker_id
+  storehouse::StorageBackend* storage(i32 worker_id);
+
+  std::shared_ptr<const TableMetadata> table_metadata(i32 worker_id,
+                                                      i32 table_id);
+
+  std::shared_ptr<const VideoMetadata> video_metadata(i32 worker_id,
+                                                      i32 table_id,
+                                                      i32 column_id,
+                                                      i32 item_id);
+
+  // Returns the open data file of an item, owned by the cache, and its size
+  storehouse::RandomReadFile* item_file(i32 worker_id, i32 table_id,
+                                        i32 column_id, i32 item_id,
+                                        u64& file_size);
+
+  // Where the column file of an item is stored, either a file of its own or
+  // a range of a table segment
+  struct ColumnChunk {
+    storehouse::RandomReadFile* file;
+    u64 offset;
+    u64 size;
+  };
+
+  ColumnChunk column_chunk(i32 worker_id, i32 table_id, i32 column_id,
+                           i32 item_id);
+
+  i64 hits() const { return hits_; }
+  i64 misses() const { return misses_; }
+
+ private:
+  using Key = std::tuple<i32, i32, i32>;
+
+  struct OpenFile {
+    i32 table_id;
+    std::unique_ptr<storehouse::RandomReadFile> file;
+    u64 size;
+    std::list<std::string>::iterator lru_it;
+  };
+
+  // Per load worker state, only touched by that worker while a job runs
+  struct WorkerFiles {
+    storehouse::StorageBackend* storage;
+    // Keyed by path
+    std::map<std::string, OpenFile> files;
+    // Most recently used first
+    std::list<std::string> lru;
+  };
+
+  storehouse::RandomReadFile* open_file(i32 worker_id, i32 table_id,
+                                        const std::string& path,
+                                        u64& file_size);
+
+  void drop_table(i32 table_id);
+
+  std::mutex mutex_;
+  std::map<i32, std::shared_ptr<const TableMetadata>> tables_;
+  std::map<Key, std::shared_ptr<const VideoMetadata>> videos_;
+  std::map<std::tuple<i32, std::string>, std::shared_ptr<const SegmentIndex>>
+      segments_;
+  std::vector<WorkerFiles> workers_;
+  std::atomic<i64> hits_{0};
+  std::atomic<i64> misses_{0};
+};
+
+}
+}
@@ -60,6 +60,7 @@ std::string default_machine_params_wrapper() {
   for (auto gpu_id : params.gpu_ids) {
     params_proto.add_gpu_ids(gpu_id);
   }
+  params_proto.set_num_load_io_threads(params.num_load_io_threads);
 
   std::string output;
   bool success = params_proto.SerializeToString(&output);
@@ -81,6 +82,7 @@ void start_worker_wrapper(Database& db, const std::string& params_s) {
   for (auto gpu_id : params_proto.gpu_ids()) {
     params.gpu_ids.push_back(gpu_id);
   }
+  params.num_load_io_threads = params_proto.num_load_io_threads();
 
   db.start_worker(params);
 }
@@ -97,6 +99,12 @@ py::list ingest_videos_wrapper(
   return to_py_list<FailedVideo>(failed_videos);
 }
 
+// Returns an error message, empty if the tables were compacted
+std::string compact_tables_wrapper(Database& db, const py::list table_names) {
+  Result result =
+      db.compact_tables(to_std_vector<std::string>(table_names));
+  return result.success() ? "" : result.msg();
+}
 
 BOOST_PYTHON_MODULE(scanner_bindings) {
   using namespace py;
@@ -109,6 +117,7 @@ BOOST_PYTHON_MODULE(scanner_bindings) {
   def("start_master", start_master_wrapper);
   def("start_worker", start_worker_wrapper);
   def("ingest_videos", ingest_videos_wrapper);
+  def("compact_tables", compact_tables_wrapper);
   def("get_include", get_include);
   def("other_flags", other_flags);
   def("get_output_columns", get_output_columns);
@@ -0,0 +1,63 @@
+/* Copyright 2016 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/engine/read_ahead_pool.h"
+
+namespace scanner {
+namespace internal {
+
+namespace {
+// Load workers block on their oldest item before leasing more, so the
+// number of queued tasks stays small
+const i32 READ_AHEAD_QUEUE_SIZE = 1024;
+}
+
+ReadAheadPool::ReadAheadPool(i32 first_slot, i32 num_threads)
+    : tasks_(READ_AHEAD_QUEUE_SIZE) {
+  for (i32 i = 0; i < num_threads; ++i) {
+    threads_.emplace_back(&ReadAheadPool::run, this, first_slot + i);
+  }
+}
+
+ReadAheadPool::~ReadAheadPool() {
+  // An empty task tells a thread to exit
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    tasks_.push(Task());
+  }
+  for (std::thread &thread : threads_) {
+    thread.join();
+  }
+}
+
+std::future<void> ReadAheadPool::submit(std::function<void(i32)> fn) {
+  Task task(std::move(fn));
+  std::future<void> future = task.get_future();
+  tasks_.push(std::move(task));
+  return future;
+}
+
+void ReadAheadPool::run(i32 slot) {
+  while (true) {
+    Task task;
+    tasks_.pop(task);
+    if (!task.valid()) {
+      break;
+    }
+    task(slot);
+  }
+}
+
+}
+}
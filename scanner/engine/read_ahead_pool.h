@@ -0,0 +1,61 @@
+/* Copyright 2016 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "scanner/util/bounded_queue.h"
+#include "scanner/util/common.h"
+
+#include <atomic>
+#include <functional>
+#include <future>
+#include <thread>
+#include <vector>
+
+namespace scanner {
+namespace internal {
+
+///////////////////////////////////////////////////////////////////////////////
+/// ReadAheadPool
+///
+/// Threads shared by the load workers of a node that read io items ahead of
+/// the one a load worker is currently handing on, so storage latency is
+/// hidden without adding load workers. Each thread owns a metadata cache slot
+/// (and with it a storage backend) which is passed to the tasks it runs.
+class ReadAheadPool {
+ public:
+  using Task = std::packaged_task<void(i32)>;
+
+  ReadAheadPool(i32 first_slot, i32 num_threads);
+  ~ReadAheadPool();
+
+  std::future<void> submit(std::function<void(i32)> fn);
+
+  // Bytes of read items that have not been handed on yet, used to keep the
+  // read ahead within its budget
+  i64 held_bytes() const { return held_bytes_; }
+  void hold(i64 bytes) { held_bytes_ += bytes; }
+  void release(i64 bytes) { held_bytes_ -= bytes; }
+
+ private:
+  void run(i32 slot);
+
+  BoundedQueue<Task> tasks_;
+  std::vector<std::thread> threads_;
+  std::atomic<i64> held_bytes_{0};
+};
+
+}
+}
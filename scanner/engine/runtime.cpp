@@ -0,0 +1,88 @@
+/* Copyright 2016 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/engine/runtime.h"
+#include "scanner/util/memory.h"
+
+namespace scanner {
+namespace internal {
+
+EvalWorkEntry &EvalWorkEntry::operator=(EvalWorkEntry &&other) {
+  if (this != &other) {
+    for (size_t c = 0; c < columns.size(); ++c) {
+      clear_column(c);
+    }
+    io_item_index = other.io_item_index;
+    columns = std::move(other.columns);
+    column_handles = std::move(other.column_handles);
+    column_types = std::move(other.column_types);
+    needs_configure = other.needs_configure;
+    needs_reset = other.needs_reset;
+    last_in_io_item = other.last_in_io_item;
+    warmup_rows = other.warmup_rows;
+    input_table_id = other.input_table_id;
+    first_input_row = other.first_input_row;
+    next_input_row = other.next_input_row;
+    other.columns.clear();
+    other.column_handles.clear();
+  }
+  return *this;
+}
+
+EvalWorkEntry::~EvalWorkEntry() {
+  for (size_t c = 0; c < columns.size(); ++c) {
+    clear_column(c);
+  }
+}
+
+void EvalWorkEntry::clear_column(size_t col) {
+  assert(col < column_handles.size() || columns[col].rows.empty());
+  for (Row &row : columns[col].rows) {
+    if (row.buffer != nullptr) {
+      delete_buffer(column_handles[col], row.buffer);
+    }
+  }
+  columns[col].rows.clear();
+}
+
+void EvalWorkEntry::erase_rows(size_t col, size_t start, size_t end) {
+  std::vector<Row> &rows = columns[col].rows;
+  for (size_t i = start; i < end; ++i) {
+    if (rows[i].buffer != nullptr) {
+      delete_buffer(column_handles[col], rows[i].buffer);
+    }
+  }
+  rows.erase(rows.begin() + start, rows.begin() + end);
+}
+
+void EvalWorkEntry::move_rows(size_t col, size_t start, size_t end,
+                              EvalWorkEntry &dest, size_t dest_col) {
+  assert(dest.column_handles[dest_col] == column_handles[col]);
+  std::vector<Row> &rows = columns[col].rows;
+  std::vector<Row> &dest_rows = dest.columns[dest_col].rows;
+  dest_rows.insert(dest_rows.end(), rows.begin() + start, rows.begin() + end);
+  for (size_t i = start; i < end; ++i) {
+    rows[i].buffer = nullptr;
+  }
+}
+
+std::vector<Row> EvalWorkEntry::take_column(size_t col) {
+  std::vector<Row> rows;
+  rows.swap(columns[col].rows);
+  return rows;
+}
+
+}
+}
@@ -30,6 +30,9 @@
 #include <grpc++/server.h>
 #include <grpc++/server_builder.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
 #include <string>
 #include <dlfcn.h>
@@ -40,16 +43,80 @@ namespace internal {
 ///////////////////////////////////////////////////////////////////////////////
 /// Work structs - structs used to exchange data between workers during
 ///   execution of the run command.
+///
+/// An EvalWorkEntry owns the buffers of the rows in its columns and frees
+/// them on the column's device when it is destroyed. Entries are move-only so
+/// handing one to the next stage never copies the row vectors. Rows only
+/// leave an entry through move_rows, which hands them to another entry in the
+/// same step, or take_column, which hands them to the caller. Ownership is
+/// kept per entry rather than per row since kernels see the rows as the plain
+/// Row structs of their BatchedColumns.
 struct EvalWorkEntry {
-  i32 io_item_index;
+  EvalWorkEntry() = default;
+  EvalWorkEntry(EvalWorkEntry &&other) = default;
+  EvalWorkEntry &operator=(EvalWorkEntry &&other);
+  EvalWorkEntry(const EvalWorkEntry &) = delete;
+  EvalWorkEntry &operator=(const EvalWorkEntry &) = delete;
+  ~EvalWorkEntry();
+
+  // Frees the buffers of every row in column col and empties it
+  void clear_column(size_t col);
+
+  // Appends rows [start, end) of column col to column dest_col of dest,
+  // which takes over their buffers. The columns must be on the same device.
+  // The rows stay in this entry without a buffer.
+  void move_rows(size_t col, size_t start, size_t end, EvalWorkEntry &dest,
+                 size_t dest_col);
+
+  // Empties column col and returns its rows, whose buffers the caller then
+  // owns
+  std::vector<Row> take_column(size_t col);
+
+  // Frees the buffers of rows [start, end) of column col and removes them
+  void erase_rows(size_t col, size_t start, size_t end);
+
+  i32 io_item_index = 0;
   BatchedColumns columns;
   std::vector<DeviceHandle> column_handles;
   // Below only for pre/evaluate/post workers
   std::vector<ColumnType> column_types;
-  bool needs_configure;
-  bool needs_reset;
-  bool last_in_io_item;
-  i64 warmup_rows;
+  bool needs_configure = false;
+  bool needs_reset = false;
+  bool last_in_io_item = false;
+  i64 warmup_rows = 0;
+  // Input rows of the first sample, excluding warmup: the table they are read
+  // from, the first row and the row that would follow the last one in its
+  // stride. Used to tell whether an item continues the previous one.
+  i32 input_table_id = -1;
+  i64 first_input_row = -1;
+  i64 next_input_row = -1;
+};
+
+/// Lets the work request loop in the worker sleep until pipeline threads have
+/// made progress instead of polling them.
+struct WorkerMonitor {
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::atomic<i64> retired_items{0};
+  std::atomic<bool> error{false};
+
+  // Called by save threads after an io item has been fully written
+  void retire_item() {
+    {
+      std::unique_lock<std::mutex> lk(mutex);
+      retired_items++;
+    }
+    cv.notify_all();
+  }
+
+  // Called by evaluate threads after recording a failed result
+  void signal_error() {
+    {
+      std::unique_lock<std::mutex> lk(mutex);
+      error = true;
+    }
+    cv.notify_all();
+  }
 };
 
 struct DatabaseParameters {
@@ -59,6 +126,7 @@ struct DatabaseParameters {
   i32 num_load_workers;
   i32 num_save_workers;
   std::vector<i32> gpu_ids;
+  i32 num_load_io_threads;
 };
 
 proto::Master::Service *get_master_service(DatabaseParameters &param);
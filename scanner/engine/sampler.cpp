@@ -71,15 +71,17 @@ public:
     i64 e = std::min(total_rows(), rows_pos_ + args_.sample_size());
     rows_pos_ = e;
     assert(rows_pos_ <= total_rows());
-    for (i64 i = ws; i < s; ++i) {
-      sample.warmup_rows.push_back(i);
-    }
-    for (i64 i = s; i < e; ++i) {
-      sample.rows.push_back(i);
+    if (ws < s) {
+      sample.warmup_rows.push_back(RowRange{ws, s, 1});
     }
+    sample.rows.push_back(RowRange{s, e, 1});
     return sample;
   }
 
+  std::vector<i64> rows_per_sample() const override {
+    return std::vector<i64>(total_samples(), args_.sample_size());
+  }
+
   void reset() override {
     rows_pos_ = 0;
   }
@@ -157,17 +159,26 @@ public:
     i64 ws = args_.warmup_starts(samples_pos_);
     i64 s = args_.starts(samples_pos_);
     i64 e = args_.ends(samples_pos_);
-    for (i64 i = ws; i < s; i += stride) {
-      sample.warmup_rows.push_back(i);
+    if (ws < s) {
+      sample.warmup_rows.push_back(RowRange{ws, s, stride});
     }
-    for (i64 i = s; i < e; i += stride) {
-      sample.rows.push_back(i);
+    if (s < e) {
+      sample.rows.push_back(RowRange{s, e, stride});
     }
     samples_pos_++;
     assert(samples_pos_ <= args_.warmup_starts_size());
     return sample;
   }
 
+  std::vector<i64> rows_per_sample() const override {
+    std::vector<i64> rows;
+    for (i64 i = 0; i < total_samples_; ++i) {
+      rows.push_back(range_num_rows(
+          RowRange{args_.starts(i), args_.ends(i), args_.stride()}));
+    }
+    return rows;
+  }
+
   void reset() override {
     samples_pos_ = 0;
   }
@@ -254,9 +265,9 @@ public:
     i64 s = args_.starts(samples_pos_);
     int curr_start = s + stride * rows_pos_;
     for (i64 off : args_.stencil()) {
-      sample.warmup_rows.push_back(curr_start + off);
+      append_row(sample.warmup_rows, curr_start + off);
     }
-    sample.rows.push_back(curr_start);
+    sample.rows.push_back(RowRange{curr_start, curr_start + 1, 1});
 
     rows_pos_++;
     i64 e = args_.ends(samples_pos_);
@@ -268,6 +279,10 @@ public:
     return sample;
   }
 
+  std::vector<i64> rows_per_sample() const override {
+    return std::vector<i64>(total_samples(), 1);
+  }
+
   void reset() override {
     samples_pos_ = 0;
     rows_pos_ = 0;
@@ -334,14 +349,25 @@ public:
   RowSample next_sample() override {
     RowSample sample;
     auto &s = args_.samples(samples_pos_);
-    sample.warmup_rows =
-        std::vector<i64>(s.warmup_rows().begin(), s.warmup_rows().end());
-    sample.rows = std::vector<i64>(s.rows().begin(), s.rows().end());
+    for (i64 r : s.warmup_rows()) {
+      append_row(sample.warmup_rows, r);
+    }
+    for (i64 r : s.rows()) {
+      append_row(sample.rows, r);
+    }
     samples_pos_++;
     assert(samples_pos_ <= args_.samples_size());
     return sample;
   }
 
+  std::vector<i64> rows_per_sample() const override {
+    std::vector<i64> rows;
+    for (auto &s : args_.samples()) {
+      rows.push_back(s.rows_size());
+    }
+    return rows;
+  }
+
   void reset() override {
     samples_pos_ = 0;
   }
@@ -484,28 +510,26 @@ Result TaskSampler::next_work(proto::NewWork& new_work) {
     for (auto col_name : sample.column_names()) {
       load_sample->add_column_ids(t_meta.column_id(col_name));
     }
-    for (i64 r : row_sample.warmup_rows) {
-      load_sample->add_warmup_rows(r);
-    }
-    for (i64 r : row_sample.rows) {
-      load_sample->add_rows(r);
-    }
+    ranges_to_proto(row_sample.warmup_rows,
+                    load_sample->mutable_warmup_ranges());
+    ranges_to_proto(row_sample.rows, load_sample->mutable_ranges());
+    i64 sample_warmup_rows = ranges_num_rows(row_sample.warmup_rows);
+    i64 sample_rows = ranges_num_rows(row_sample.rows);
     if (i == 0) {
-      warmup_rows = row_sample.warmup_rows.size();
-      rows = row_sample.rows.size();
+      warmup_rows = sample_warmup_rows;
+      rows = sample_rows;
     } else {
-      if (row_sample.warmup_rows.size() != warmup_rows) {
+      if (sample_warmup_rows != warmup_rows) {
         RESULT_ERROR(&valid_, "Samplers for task %s output a different number "
                               "of warmup rows per sample (%ld vs. %ld)",
-                     task_.output_table_name().c_str(),
-                     row_sample.warmup_rows.size(), warmup_rows);
+                     task_.output_table_name().c_str(), sample_warmup_rows,
+                     warmup_rows);
         return valid_;
       }
-      if (row_sample.rows.size() != rows) {
+      if (sample_rows != rows) {
         RESULT_ERROR(&valid_, "Samplers for task %s output a different number "
                               "of rows per sample (%ld vs. %ld)",
-                     task_.output_table_name().c_str(), row_sample.rows.size(),
-                     rows);
+                     task_.output_table_name().c_str(), sample_rows, rows);
         return valid_;
       }
     }
@@ -521,6 +545,27 @@ Result TaskSampler::next_work(proto::NewWork& new_work) {
 
   return valid_;
 }
+Result TaskSampler::end_rows(std::vector<i64>& end_rows) {
+  if (!valid_.success()) {
+    return valid_;
+  }
+
+  std::vector<i64> rows = samplers_[0]->rows_per_sample();
+  for (size_t i = 1; i < samplers_.size(); ++i) {
+    if (samplers_[i]->rows_per_sample() != rows) {
+      RESULT_ERROR(&valid_, "Samplers for task %s output a different number "
+                            "of rows per sample",
+                   task_.output_table_name().c_str());
+      return valid_;
+    }
+  }
+  i64 end_row = 0;
+  for (i64 r : rows) {
+    end_row += r;
+    end_rows.push_back(end_row);
+  }
+  return valid_;
+}
 
 }
 }
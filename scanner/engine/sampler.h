@@ -16,6 +16,7 @@
 #pragma once
 
 #include "scanner/engine/db.h"
+#include "scanner/engine/sampling.h"
 #include "scanner/util/common.h"
 #include "scanner/util/profiler.h"
 
@@ -36,8 +37,8 @@ namespace internal {
  */
 
 struct RowSample {
-  std::vector<i64> warmup_rows;
-  std::vector<i64> rows;
+  std::vector<RowRange> warmup_rows;
+  std::vector<RowRange> rows;
 };
 
 class Sampler {
@@ -55,6 +56,9 @@ public:
 
   virtual RowSample next_sample() = 0;
 
+  // Number of rows of each sample, computed without producing the samples
+  virtual std::vector<i64> rows_per_sample() const = 0;
+
   virtual void reset() = 0;
 
 protected:
@@ -80,6 +84,9 @@ public:
 
   Result next_work(proto::NewWork& new_work);
 
+  // End rows of the output table, one per sample
+  Result end_rows(std::vector<i64>& end_rows);
+
 private:
   const std::map<std::string, TableMetadata>& table_metas_;
   const proto::Task& task_;
@@ -15,105 +15,193 @@
 
 #include "scanner/engine/sampling.h"
 
+#include <algorithm>
+
 namespace scanner {
 namespace internal {
 
-// Gets the list of work items for a sequence of rows in the job
+i64 range_num_rows(const RowRange &range) {
+  if (range.end <= range.start) {
+    return 0;
+  }
+  return (range.end - range.start + range.stride - 1) / range.stride;
+}
+
+i64 ranges_num_rows(const std::vector<RowRange> &ranges) {
+  i64 rows = 0;
+  for (const RowRange &range : ranges) {
+    rows += range_num_rows(range);
+  }
+  return rows;
+}
+
+void append_row(std::vector<RowRange> &ranges, i64 row) {
+  if (!ranges.empty()) {
+    RowRange &last = ranges.back();
+    i64 num_rows = range_num_rows(last);
+    i64 last_row = last.start + (num_rows - 1) * last.stride;
+    if (num_rows == 1 && row > last_row) {
+      last.stride = row - last_row;
+      last.end = row + 1;
+      return;
+    } else if (row == last_row + last.stride) {
+      last.end = row + 1;
+      return;
+    }
+  }
+  ranges.push_back(RowRange{row, row + 1, 1});
+}
+
+void ranges_to_proto(
+    const std::vector<RowRange> &ranges,
+    google::protobuf::RepeatedPtrField<proto::RowRange> *proto_ranges) {
+  for (const RowRange &range : ranges) {
+    proto::RowRange *proto_range = proto_ranges->Add();
+    proto_range->set_start(range.start);
+    proto_range->set_end(range.end);
+    proto_range->set_stride(range.stride);
+  }
+}
+
+std::vector<RowRange> ranges_from_proto(
+    const google::protobuf::RepeatedPtrField<proto::RowRange> &proto_ranges) {
+  std::vector<RowRange> ranges;
+  for (const proto::RowRange &range : proto_ranges) {
+    ranges.push_back(RowRange{range.start(), range.end(), range.stride()});
+  }
+  return ranges;
+}
+
+std::vector<i64> expand_ranges(const std::vector<RowRange> &ranges) {
+  std::vector<i64> rows;
+  rows.reserve(ranges_num_rows(ranges));
+  for (const RowRange &range : ranges) {
+    for (i64 r = range.start; r < range.end; r += range.stride) {
+      rows.push_back(r);
+    }
+  }
+  return rows;
+}
+
 RowIntervals slice_into_row_intervals(const TableMetadata &table,
-                                      const std::vector<i64> &rows) {
+                                      const std::vector<RowRange> &ranges) {
   RowIntervals info;
-  // Analyze rows and table to determine what item ids and offsets in them to
-  // sample from
+  // end_rows holds the row after the last row of each item
   std::vector<i64> end_rows = table.end_rows();
-  auto item_from_row = [&end_rows](i64 r) -> i32 {
-    i64 i = 0;
-    for (; i < end_rows.size(); ++i) {
-      if (r < end_rows[i]) {
-        break;
+  i64 item_start_row = 0;
+  i64 item_end_row = 0;
+  for (const RowRange &range : ranges) {
+    i64 row = range.start;
+    while (row < range.end) {
+      if (row < item_start_row || row >= item_end_row) {
+        // Items are found by binary search, so skipping over items without
+        // sampled rows is cheap
+        i32 item = std::upper_bound(end_rows.begin(), end_rows.end(), row) -
+                   end_rows.begin();
+        assert(item < end_rows.size());
+        item_start_row = item == 0 ? 0 : end_rows[item - 1];
+        item_end_row = end_rows[item];
+        info.item_ids.push_back(item);
+        info.valid_offsets.emplace_back();
       }
-    }
-    assert(i != end_rows.size());
-    return i;
-  };
-
-  auto offset_from_row = [&end_rows](i64 r) -> i64 {
-    i64 i = 0;
-    i64 sum = 0;
-    for (; i < end_rows.size(); ++i) {
-      if (r < end_rows[i]) {
-        break;
+      std::vector<i64> &valid_offsets = info.valid_offsets.back();
+      i64 end = std::min(range.end, item_end_row);
+      for (; row < end; row += range.stride) {
+        valid_offsets.push_back(row - item_start_row);
       }
-      sum += end_rows[i];
-    }
-    assert(i != end_rows.size());
-    return r - sum;
-  };
-
-  assert(!rows.empty());
-  i32 current_item = item_from_row(rows[0]);
-  i64 item_start = offset_from_row(rows[0]);
-  i64 item_end = item_start + 1;
-  std::vector<i64> valid_offsets;
-  for (i64 row : rows) {
-    i32 item = item_from_row(row);
-    i64 item_offset = offset_from_row(row);
-    if (item != current_item) {
-      // Start a new item and push the current one into the list
-      info.item_ids.push_back(current_item);
-      info.item_intervals.push_back(std::make_tuple(item_start, item_end));
-      info.valid_offsets.push_back(valid_offsets);
-
-      current_item = item;
-      item_start = item_offset;
-      item_end = item_offset + 1;
-      valid_offsets.clear();
     }
-
-    valid_offsets.push_back(item_offset);
-    item_end = item_offset + 1;
   }
-  info.item_ids.push_back(current_item);
-  info.item_intervals.push_back(std::make_tuple(item_start, item_end));
-  info.valid_offsets.push_back(valid_offsets);
+  for (const std::vector<i64> &valid_offsets : info.valid_offsets) {
+    info.item_intervals.push_back(
+        std::make_tuple(valid_offsets.front(), valid_offsets.back() + 1));
+  }
 
   return info;
 }
 
+namespace {
+
+// Costs used to plan decode intervals, in units of decoding one frame of
+// average size. Starting a new interval needs a separate read and a decoder
+// flush. GOPs between intervals that are read through instead are skipped by
+// the decoder, so they only cost reading their bytes.
+const f64 SEEK_COST = 16.0;
+const f64 READ_THROUGH_COST = 0.05;
+
+}
+
 VideoIntervals
 slice_into_video_intervals(const std::vector<i64> &keyframe_positions,
+                           const std::vector<i64> &keyframe_byte_offsets,
                            const std::vector<i64> &rows) {
   VideoIntervals info;
   assert(keyframe_positions.size() >= 2);
-  size_t start_keyframe_index = 0;
-  size_t end_keyframe_index = 1;
-  i64 next_keyframe = keyframe_positions[end_keyframe_index];
+  assert(keyframe_positions.size() == keyframe_byte_offsets.size());
+  assert(!rows.empty());
+
+  i64 total_frames = keyframe_positions.back() - keyframe_positions.front();
+  i64 total_bytes = keyframe_byte_offsets.back() - keyframe_byte_offsets.front();
+  f64 frame_bytes =
+      std::max(static_cast<f64>(total_bytes) / std::max(total_frames, (i64)1), 1.0);
+
+  // GOP g spans [keyframe_positions[g], keyframe_positions[g + 1])
+  auto gop_of = [&keyframe_positions](i64 row, size_t gop) {
+    while (row >= keyframe_positions[gop + 1]) {
+      gop++;
+      assert(gop < keyframe_positions.size() - 1);
+    }
+    return gop;
+  };
+
+  size_t start_gop = gop_of(rows[0], 0);
+  size_t end_gop = start_gop;
   std::vector<i64> valid_frames;
   for (i64 row : rows) {
-    if (row >= next_keyframe) {
-      assert(end_keyframe_index < keyframe_positions.size() - 1);
-      next_keyframe = keyframe_positions[++end_keyframe_index];
-      if (row >= next_keyframe) {
-        // Skipped a keyframe, so make a new interval
-        if (!valid_frames.empty()) {
-          info.keyframe_index_intervals.push_back(
-              std::make_tuple(start_keyframe_index, end_keyframe_index - 1));
-          info.valid_frames.push_back(valid_frames);
-        }
-
-        while (row >= keyframe_positions[end_keyframe_index]) {
-          end_keyframe_index++;
-          assert(end_keyframe_index < keyframe_positions.size());
-        }
+    size_t gop = gop_of(row, end_gop);
+    if (gop > end_gop + 1) {
+      i64 gap_bytes =
+          keyframe_byte_offsets[gop] - keyframe_byte_offsets[end_gop + 1];
+      f64 read_through_cost = gap_bytes / frame_bytes * READ_THROUGH_COST;
+      if (read_through_cost > SEEK_COST) {
+        info.keyframe_index_intervals.push_back(
+            std::make_tuple(start_gop, end_gop + 1));
+        info.valid_frames.push_back(valid_frames);
         valid_frames.clear();
-        start_keyframe_index = end_keyframe_index - 1;
-        next_keyframe = keyframe_positions[end_keyframe_index];
+        start_gop = gop;
       }
     }
+    end_gop = gop;
     valid_frames.push_back(row);
   }
   info.keyframe_index_intervals.push_back(
-      std::make_tuple(start_keyframe_index, end_keyframe_index));
+      std::make_tuple(start_gop, end_gop + 1));
   info.valid_frames.push_back(valid_frames);
+
+  // Frames the decoder is expected to decode. GOPs without requested frames
+  // are skipped and GOPs only needed for their keyframe decode just that.
+  // Otherwise a GOP is decoded up to its last requested frame, or entirely
+  // if the decoder moves on to another GOP afterwards.
+  info.decoded_frames = 0;
+  size_t num_intervals = info.keyframe_index_intervals.size();
+  for (size_t i = 0; i < num_intervals; ++i) {
+    const std::vector<i64> &valid = info.valid_frames[i];
+    size_t first_gop, last_gop;
+    std::tie(first_gop, last_gop) = info.keyframe_index_intervals[i];
+    auto it = valid.begin();
+    for (size_t g = first_gop; g < last_gop; ++g) {
+      i64 keyframe = keyframe_positions[g];
+      i64 next_keyframe = keyframe_positions[g + 1];
+      auto gop_end = std::lower_bound(it, valid.end(), next_keyframe);
+      if (gop_end - it == 1 && *it == keyframe) {
+        info.decoded_frames += 1;
+      } else if (gop_end != it) {
+        bool last = (i == num_intervals - 1 && g == last_gop - 1);
+        info.decoded_frames +=
+            last ? *(gop_end - 1) - keyframe + 1 : next_keyframe - keyframe;
+      }
+      it = gop_end;
+    }
+  }
   return info;
 }
 }
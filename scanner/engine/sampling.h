@@ -21,24 +21,57 @@
 namespace scanner {
 namespace internal {
 
+// Rows start, start + stride, ... before end. Samplers describe their rows as
+// a list of ranges so that large samples stay small all the way to the load
+// workers.
+struct RowRange {
+  i64 start;
+  i64 end;
+  i64 stride;
+};
+
+i64 range_num_rows(const RowRange &range);
+
+i64 ranges_num_rows(const std::vector<RowRange> &ranges);
+
+// Appends a row to ranges, extending the last range when the row continues
+// its stride
+void append_row(std::vector<RowRange> &ranges, i64 row);
+
+void ranges_to_proto(
+    const std::vector<RowRange> &ranges,
+    google::protobuf::RepeatedPtrField<proto::RowRange> *proto_ranges);
+
+std::vector<RowRange> ranges_from_proto(
+    const google::protobuf::RepeatedPtrField<proto::RowRange> &proto_ranges);
+
+std::vector<i64> expand_ranges(const std::vector<RowRange> &ranges);
+
 struct RowIntervals {
   std::vector<i32> item_ids;
   std::vector<std::tuple<i64, i64>> item_intervals;
   std::vector<std::vector<i64>> valid_offsets;
 };
 
-// Gets the list of work items for a sequence of rows in the job
+// Gets the list of work items for increasing rows of a table
 RowIntervals
 slice_into_row_intervals(const TableMetadata &table,
-                         const std::vector<i64> &rows);
+                         const std::vector<RowRange> &ranges);
 
 struct VideoIntervals {
   std::vector<std::tuple<size_t, size_t>> keyframe_index_intervals;
   std::vector<std::vector<i64>> valid_frames;
+  // Estimate of the frames decoded to produce the valid frames
+  i64 decoded_frames;
 };
 
+// Plans the intervals of a video to decode the rows from. Runs of GOPs
+// without requested rows are either read through or seeked over, whichever
+// is estimated to be cheaper. keyframe_positions and keyframe_byte_offsets
+// end with the number of frames and bytes of the video.
 VideoIntervals
 slice_into_video_intervals(const std::vector<i64> &keyframe_positions,
+                           const std::vector<i64> &keyframe_byte_offsets,
                            const std::vector<i64> &rows);
 }
 }
@@ -0,0 +1,200 @@
+/* Copyright 2016 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/engine/sampler.h"
+#include "scanner/engine/sampling.h"
+
+#include <gtest/gtest.h>
+
+namespace scanner {
+namespace internal {
+namespace {
+// Table with num_items items of rows_per_item rows each
+TableMetadata make_table(i32 num_items, i64 rows_per_item) {
+  proto::TableDescriptor desc;
+  desc.set_id(0);
+  desc.set_name("test");
+  for (i32 i = 0; i < num_items; ++i) {
+    desc.add_end_rows((i + 1) * rows_per_item);
+  }
+  return TableMetadata(desc);
+}
+
+// Video with a keyframe every gop_size frames and frame_bytes bytes per frame
+void make_video(i64 num_frames, i64 gop_size, i64 frame_bytes,
+                std::vector<i64>& keyframe_positions,
+                std::vector<i64>& keyframe_byte_offsets) {
+  for (i64 k = 0; k <= num_frames; k += gop_size) {
+    keyframe_positions.push_back(k);
+    keyframe_byte_offsets.push_back(k * frame_bytes);
+  }
+}
+
+std::tuple<size_t, size_t> gops(size_t start, size_t end) {
+  return std::make_tuple(start, end);
+}
+}
+
+TEST(RowRanges, AppendRowCompresses) {
+  std::vector<RowRange> ranges;
+  for (i64 r : {1, 3, 5, 6, 7, 8, 20}) {
+    append_row(ranges, r);
+  }
+  ASSERT_EQ(ranges.size(), 3);
+  EXPECT_EQ(ranges[0].start, 1);
+  EXPECT_EQ(ranges[0].end, 6);
+  EXPECT_EQ(ranges[0].stride, 2);
+  EXPECT_EQ(ranges[1].start, 6);
+  EXPECT_EQ(ranges[1].end, 9);
+  EXPECT_EQ(ranges[1].stride, 1);
+  EXPECT_EQ(ranges[2].start, 20);
+  EXPECT_EQ(ranges_num_rows(ranges), 7);
+  EXPECT_EQ(expand_ranges(ranges),
+            std::vector<i64>({1, 3, 5, 6, 7, 8, 20}));
+}
+
+TEST(RowIntervals, OffsetsWithinItems) {
+  TableMetadata table = make_table(4, 10);
+  RowIntervals info =
+      slice_into_row_intervals(table, {RowRange{5, 35, 1}});
+  ASSERT_EQ(info.item_ids, std::vector<i32>({0, 1, 2, 3}));
+  EXPECT_EQ(info.valid_offsets[0].front(), 5);
+  EXPECT_EQ(info.valid_offsets[0].size(), 5);
+  // Offsets are relative to the start of their item
+  EXPECT_EQ(info.valid_offsets[2].front(), 0);
+  EXPECT_EQ(info.valid_offsets[2].back(), 9);
+  EXPECT_EQ(info.item_intervals[3], std::make_tuple(0l, 5l));
+}
+
+TEST(RowIntervals, StridedAcrossItems) {
+  TableMetadata table = make_table(10, 7);
+  std::vector<RowRange> ranges = {RowRange{0, 3, 1}, RowRange{10, 70, 15}};
+  RowIntervals info = slice_into_row_intervals(table, ranges);
+  // Rows 10, 25, 40 and 55 skip over items 2, 4, 6 and 8
+  ASSERT_EQ(info.item_ids, std::vector<i32>({0, 1, 3, 5, 7}));
+  EXPECT_EQ(info.valid_offsets[0], std::vector<i64>({0, 1, 2}));
+  EXPECT_EQ(info.valid_offsets[1], std::vector<i64>({3}));
+  EXPECT_EQ(info.valid_offsets[2], std::vector<i64>({4}));
+  EXPECT_EQ(info.valid_offsets[3], std::vector<i64>({5}));
+  EXPECT_EQ(info.valid_offsets[4], std::vector<i64>({6}));
+}
+
+TEST(Sampler, RowsPerSampleMatchesSamples) {
+  TableMetadata table = make_table(4, 100);
+  proto::StridedRangeSamplerArgs args;
+  args.set_stride(3);
+  for (i64 s : {0, 10, 50, 51}) {
+    args.add_warmup_starts(s);
+    args.add_starts(s);
+    args.add_ends(std::min(s + 20, (i64)400));
+  }
+  std::vector<u8> arg_bytes(args.ByteSize());
+  args.SerializeToArray(arg_bytes.data(), arg_bytes.size());
+
+  Sampler *sampler = nullptr;
+  Result result =
+      make_sampler_instance("StridedRange", arg_bytes, table, sampler);
+  ASSERT_TRUE(result.success());
+  std::vector<i64> rows = sampler->rows_per_sample();
+  ASSERT_EQ(rows.size(), sampler->total_samples());
+  for (i64 r : rows) {
+    EXPECT_EQ(r, ranges_num_rows(sampler->next_sample().rows));
+  }
+  delete sampler;
+}
+
+TEST(VideoIntervals, SparseRowsSeek) {
+  std::vector<i64> positions, offsets;
+  make_video(1000, 100, 100, positions, offsets);
+  // Reading through the 800 frames between the rows costs more than a seek
+  VideoIntervals info = slice_into_video_intervals(positions, offsets,
+                                                   {5, 905});
+  ASSERT_EQ(info.keyframe_index_intervals.size(), 2);
+  EXPECT_EQ(info.keyframe_index_intervals[0], gops(0, 1));
+  EXPECT_EQ(info.keyframe_index_intervals[1], gops(9, 10));
+  EXPECT_EQ(info.valid_frames[0], std::vector<i64>({5}));
+  EXPECT_EQ(info.valid_frames[1], std::vector<i64>({905}));
+  // The first GOP is decoded entirely before seeking, the last one only up
+  // to its requested frame
+  EXPECT_EQ(info.decoded_frames, 100 + 6);
+}
+
+TEST(VideoIntervals, DenseRowsReadThrough) {
+  std::vector<i64> positions, offsets;
+  make_video(1000, 100, 100, positions, offsets);
+  // Reading through 200 frames is cheaper than a seek
+  VideoIntervals info = slice_into_video_intervals(positions, offsets,
+                                                   {5, 305});
+  ASSERT_EQ(info.keyframe_index_intervals.size(), 1);
+  EXPECT_EQ(info.keyframe_index_intervals[0], gops(0, 4));
+  EXPECT_EQ(info.valid_frames[0], std::vector<i64>({5, 305}));
+  // GOPs 1 and 2 are read but not decoded
+  EXPECT_EQ(info.decoded_frames, 100 + 6);
+}
+
+TEST(VideoIntervals, SeekCostThreshold) {
+  // A 320 frame gap costs exactly as much as a seek, so it is read through
+  {
+    std::vector<i64> positions = {0, 10, 330, 340};
+    std::vector<i64> offsets = {0, 1000, 33000, 34000};
+    VideoIntervals info =
+        slice_into_video_intervals(positions, offsets, {0, 335});
+    ASSERT_EQ(info.keyframe_index_intervals.size(), 1);
+    EXPECT_EQ(info.keyframe_index_intervals[0], gops(0, 3));
+    EXPECT_EQ(info.decoded_frames, 1 + 6);
+  }
+  // One more frame makes the seek cheaper
+  {
+    std::vector<i64> positions = {0, 10, 331, 341};
+    std::vector<i64> offsets = {0, 1000, 33100, 34100};
+    VideoIntervals info =
+        slice_into_video_intervals(positions, offsets, {0, 336});
+    ASSERT_EQ(info.keyframe_index_intervals.size(), 2);
+    EXPECT_EQ(info.keyframe_index_intervals[0], gops(0, 1));
+    EXPECT_EQ(info.keyframe_index_intervals[1], gops(2, 3));
+    EXPECT_EQ(info.decoded_frames, 1 + 6);
+  }
+}
+
+TEST(VideoIntervals, RowsOnKeyframeBoundaries) {
+  std::vector<i64> positions, offsets;
+  make_video(1000, 100, 100, positions, offsets);
+  // Row 100 is the keyframe starting GOP 1 and row 999 the last frame
+  VideoIntervals info = slice_into_video_intervals(positions, offsets,
+                                                   {99, 100, 200, 250, 999});
+  ASSERT_EQ(info.keyframe_index_intervals.size(), 2);
+  EXPECT_EQ(info.keyframe_index_intervals[0], gops(0, 3));
+  EXPECT_EQ(info.keyframe_index_intervals[1], gops(9, 10));
+  EXPECT_EQ(info.valid_frames[0], std::vector<i64>({99, 100, 200, 250}));
+  EXPECT_EQ(info.valid_frames[1], std::vector<i64>({999}));
+  // GOPs 0 and 2 are decoded entirely since the decoder moves on afterwards,
+  // GOP 1 only for its keyframe and GOP 9 up to its last frame
+  EXPECT_EQ(info.decoded_frames, 100 + 1 + 100 + 100);
+}
+
+TEST(RowIntervals, DISABLED_SliceBenchmark) {
+  const i64 rows_per_item = 100;
+  for (i32 num_items : {100, 10000, 100000}) {
+    TableMetadata table = make_table(num_items, rows_per_item);
+    i64 num_rows = num_items * rows_per_item;
+    RowIntervals info =
+        slice_into_row_intervals(table, {RowRange{0, num_rows, 1}});
+    ASSERT_EQ(info.item_ids.size(), num_items);
+    EXPECT_EQ(info.item_intervals.back(), std::make_tuple(0l, rows_per_item));
+    EXPECT_EQ(info.valid_offsets.back().size(), rows_per_item);
+  }
+}
+}
+}
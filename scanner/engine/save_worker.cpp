@@ -16,6 +16,7 @@
 #include "scanner/engine/save_worker.h"
 
 #include "scanner/engine/db.h"
+#include "scanner/engine/table_segments.h"
 #include "scanner/util/common.h"
 #include "scanner/util/storehouse.h"
 
@@ -30,6 +31,11 @@ using storehouse::RandomReadFile;
 namespace scanner {
 namespace internal {
 
+namespace {
+// Threads of each save thread which lay out large output columns
+const i32 SAVE_STAGING_THREADS = 4;
+}
+
 void *save_thread(void *arg) {
   SaveThreadArgs &args = *reinterpret_cast<SaveThreadArgs *>(arg);
 
@@ -39,6 +45,20 @@ void *save_thread(void *arg) {
   storehouse::StorageBackend *storage =
       storehouse::StorageBackend::make_from_config(args.storage_config);
 
+  // The output columns of the items of each table are packed into segments
+  StagingPool staging_pool(SAVE_STAGING_THREADS);
+  std::map<i32, std::unique_ptr<SegmentWriter>> segment_writers;
+  i32 next_segment = 0;
+  auto finish_segment = [&](i32 table_id) {
+    auto io_start = now();
+    proto::WrittenSegment written;
+    written.set_table_id(table_id);
+    *written.mutable_segment() = segment_writers.at(table_id)->finish();
+    args.segments.push_back(written);
+    segment_writers.erase(table_id);
+    args.profiler.add_interval("io", io_start, now());
+  };
+
   args.profiler.add_interval("setup", setup_start, now());
 
   while (true) {
@@ -60,18 +80,21 @@ void *save_thread(void *arg) {
 
     auto work_start = now();
 
-    // Write out each output column to an individual data file
+    std::unique_ptr<SegmentWriter> &segment_writer =
+        segment_writers[io_item.table_id()];
+    if (!segment_writer) {
+      // Names only have to be unique among the segments of the table
+      std::string name = std::to_string(args.node_id) + "_" +
+                         std::to_string(args.id) + "_" +
+                         std::to_string(next_segment++);
+      segment_writer.reset(new SegmentWriter(storage, io_item.table_id(),
+                                             name, &staging_pool));
+    }
+
+    // Bring the output columns to the CPU
     for (size_t out_idx = 0; out_idx < work_entry.columns.size(); ++out_idx) {
       u64 num_rows = static_cast<u64>(work_entry.columns[out_idx].rows.size());
 
-      const std::string output_path = table_item_output_path(
-          io_item.table_id(), out_idx, io_item.item_id());
-
-      auto io_start = now();
-
-      WriteFile *output_file = nullptr;
-      BACKOFF_FAIL(storage->make_write_file(output_path, output_file));
-
       if (work_entry.columns[out_idx].rows.size() != num_rows) {
         LOG(FATAL) << "Output layer's row vector has wrong length";
       }
@@ -109,37 +132,23 @@ void *save_thread(void *arg) {
             work_entry.columns[out_idx].rows[f].buffer = dest_buffers[f];
           }
         }
+        work_entry.column_handles[out_idx] = CPU_DEVICE;
       }
+    }
 
-      // Write number of rows in the file
-      s_write(output_file, num_rows);
-      // Write out all output sizes first so we can easily index into the file
-      i64 size_written = 0;
-      for (size_t i = 0; i < num_rows; ++i) {
-        i64 buffer_size = work_entry.columns[out_idx].rows[i].size;
-        s_write(output_file, buffer_size);
-        size_written += sizeof(i64);
-      }
-      // Write actual output data
-      for (size_t i = 0; i < num_rows; ++i) {
-        i64 buffer_size = work_entry.columns[out_idx].rows[i].size;
-        u8 *buffer = work_entry.columns[out_idx].rows[i].buffer;
-        s_write(output_file, buffer, buffer_size);
-        size_written += buffer_size;
-      }
-
-      BACKOFF_FAIL(output_file->save());
-
-      // TODO(apoms): For now, all evaluators are expected to return CPU
-      //   buffers as output so just assume CPU
-      for (size_t i = 0; i < num_rows; ++i) {
-        delete_buffer(CPU_DEVICE, work_entry.columns[out_idx].rows[i].buffer);
-      }
-
-      delete output_file;
+    // Append all output columns to the segment of the table in one write
+    auto io_start = now();
+    u64 size_before = segment_writer->size();
+    segment_writer->add_columns(io_item.item_id(), work_entry.columns);
+    i64 size_written = segment_writer->size() - size_before;
+    for (size_t out_idx = 0; out_idx < work_entry.columns.size(); ++out_idx) {
+      work_entry.clear_column(out_idx);
+    }
+    args.profiler.add_interval("io", io_start, now());
+    args.profiler.increment("io_write", size_written);
 
-      args.profiler.add_interval("io", io_start, now());
-      args.profiler.increment("io_write", size_written);
+    if (segment_writer->size() >= TABLE_SEGMENT_SIZE) {
+      finish_segment(io_item.table_id());
     }
 
     VLOG(1) << "Save (N/KI: " << args.node_id << "/" << args.id
@@ -147,7 +156,11 @@ void *save_thread(void *arg) {
 
     args.profiler.add_interval("task", work_start, now());
 
-    args.retired_items++;
+    args.monitor.retire_item();
+  }
+
+  while (!segment_writers.empty()) {
+    finish_segment(segment_writers.begin()->first);
   }
 
   VLOG(1) << "Save (N/KI: " << args.node_id << "/" << args.id
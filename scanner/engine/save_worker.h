@@ -17,7 +17,7 @@
 
 #include "scanner/engine/runtime.h"
 #include "scanner/util/common.h"
-#include "scanner/util/queue.h"
+#include "scanner/util/bounded_queue.h"
 
 namespace scanner {
 namespace internal {
@@ -33,8 +33,11 @@ struct SaveThreadArgs {
   Profiler& profiler;
 
   // Queues for communicating work
-  Queue<std::tuple<IOItem, EvalWorkEntry>>& input_work;
-  std::atomic<i64>& retired_items;
+  BoundedQueue<std::tuple<IOItem, EvalWorkEntry>>& input_work;
+  WorkerMonitor& monitor;
+
+  // Table segments written by this worker
+  std::vector<proto::WrittenSegment>& segments;  // out
 };
 
 void* save_thread(void* arg);
@@ -0,0 +1,281 @@
+/* Copyright 2016 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/engine/table_segments.h"
+
+#include <glog/logging.h>
+
+#include <cstring>
+
+using storehouse::StoreResult;
+using storehouse::WriteFile;
+using storehouse::RandomReadFile;
+
+namespace scanner {
+namespace internal {
+
+namespace {
+// Columns at least this large are laid out on the staging pool
+const u64 PARALLEL_STAGING_SIZE = 4 * 1024 * 1024;
+}
+
+SegmentIndex read_segment_index(RandomReadFile *file, u64 file_size) {
+  LOG_IF(FATAL, file_size < 2 * sizeof(u64))
+      << "Table segment " << file->path() << " is truncated";
+  u64 pos = file_size - 2 * sizeof(u64);
+  u64 num_entries = s_read<u64>(file, pos);
+  u64 magic = s_read<u64>(file, pos);
+  LOG_IF(FATAL, magic != SEGMENT_FILE_MAGIC)
+      << "Table segment " << file->path() << " has no index";
+
+  std::vector<SegmentIndexEntry> entries(num_entries);
+  size_t index_size = num_entries * sizeof(SegmentIndexEntry);
+  pos = file_size - 2 * sizeof(u64) - index_size;
+  s_read(file, reinterpret_cast<u8 *>(entries.data()), index_size, pos);
+
+  SegmentIndex index;
+  for (const SegmentIndexEntry &entry : entries) {
+    index[std::make_tuple(entry.item_id, entry.column_id)] =
+        std::make_tuple(entry.offset, entry.size);
+  }
+  return index;
+}
+
+u64 column_file_size(const std::vector<Row> &rows) {
+  u64 size = (rows.size() + 3) * sizeof(u64);
+  for (const Row &row : rows) {
+    size += row.size;
+  }
+  return size;
+}
+
+void stage_column_file(const std::vector<Row> &rows, u8 *buffer) {
+  u64 num_rows = rows.size();
+  u64 *header = reinterpret_cast<u64 *>(buffer);
+  header[0] = COLUMN_FILE_MAGIC;
+  header[1] = num_rows;
+  u64 *row_offsets = header + 2;
+  row_offsets[0] = 0;
+  for (size_t i = 0; i < num_rows; ++i) {
+    row_offsets[i + 1] = row_offsets[i] + rows[i].size;
+  }
+  u8 *data = buffer + (num_rows + 3) * sizeof(u64);
+  for (size_t i = 0; i < num_rows; ++i) {
+    std::memcpy(data + row_offsets[i], rows[i].buffer, rows[i].size);
+  }
+}
+
+StagingPool::StagingPool(i32 num_threads) : tasks_(std::max(num_threads, 1)) {
+  for (i32 i = 0; i < num_threads; ++i) {
+    threads_.emplace_back(&StagingPool::run, this);
+  }
+}
+
+StagingPool::~StagingPool() {
+  // An empty task tells a thread to exit
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    tasks_.push(Task());
+  }
+  for (std::thread &thread : threads_) {
+    thread.join();
+  }
+}
+
+std::future<void> StagingPool::submit(std::function<void()> fn) {
+  Task task(std::move(fn));
+  std::future<void> future = task.get_future();
+  tasks_.push(std::move(task));
+  return future;
+}
+
+void StagingPool::run() {
+  while (true) {
+    Task task;
+    tasks_.pop(task);
+    if (!task.valid()) {
+      break;
+    }
+    task();
+  }
+}
+
+SegmentWriter::SegmentWriter(storehouse::StorageBackend *storage, i32 table_id,
+                             const std::string &name,
+                             StagingPool *staging_pool)
+    : staging_pool_(staging_pool) {
+  segment_.set_name(name);
+  BACKOFF_FAIL(storehouse::make_unique_write_file(
+      storage, table_segment_path(table_id, name), file_));
+}
+
+SegmentWriter::~SegmentWriter() {
+  LOG_IF(ERROR, file_ != nullptr)
+      << "Table segment " << segment_.name() << " was never finished";
+}
+
+void SegmentWriter::add_columns(i64 item_id,
+                                const std::vector<RowList> &columns) {
+  std::vector<u64> offsets(columns.size() + 1);
+  offsets[0] = 0;
+  for (size_t c = 0; c < columns.size(); ++c) {
+    offsets[c + 1] = offsets[c] + column_file_size(columns[c].rows);
+  }
+  u64 total_size = offsets.back();
+  if (staging_.size() < total_size) {
+    staging_.resize(total_size);
+  }
+
+  // Columns go to disjoint parts of the staging buffer. Copying small
+  // columns is cheaper than handing them to the pool.
+  std::vector<std::future<void>> staged;
+  for (size_t c = 0; c < columns.size(); ++c) {
+    u8 *buffer = staging_.data() + offsets[c];
+    const std::vector<Row> &rows = columns[c].rows;
+    if (staging_pool_ != nullptr &&
+        offsets[c + 1] - offsets[c] >= PARALLEL_STAGING_SIZE &&
+        c + 1 < columns.size()) {
+      staged.push_back(staging_pool_->submit(
+          [&rows, buffer]() { stage_column_file(rows, buffer); }));
+    } else {
+      stage_column_file(rows, buffer);
+    }
+  }
+  for (std::future<void> &future : staged) {
+    future.get();
+  }
+
+  s_write(file_.get(), staging_.data(), total_size);
+  for (size_t c = 0; c < columns.size(); ++c) {
+    add_entry(item_id, c, offsets[c + 1] - offsets[c]);
+  }
+}
+
+void SegmentWriter::add_column_file(i64 item_id, i64 column_id, const u8 *data,
+                                    size_t size) {
+  s_write(file_.get(), data, size);
+  add_entry(item_id, column_id, size);
+}
+
+void SegmentWriter::add_entry(i64 item_id, i64 column_id, u64 size) {
+  index_.push_back(SegmentIndexEntry{item_id, column_id, size_, size});
+  size_ += size;
+  i32 num_items = segment_.item_ids_size();
+  if (num_items == 0 || segment_.item_ids(num_items - 1) != item_id) {
+    segment_.add_item_ids(item_id);
+  }
+}
+
+proto::TableSegment SegmentWriter::finish() {
+  s_write(file_.get(), reinterpret_cast<u8 *>(index_.data()),
+          index_.size() * sizeof(SegmentIndexEntry));
+  s_write(file_.get(), static_cast<u64>(index_.size()));
+  s_write(file_.get(), SEGMENT_FILE_MAGIC);
+  BACKOFF_FAIL(file_->save());
+  file_.reset();
+  return segment_;
+}
+
+void record_table_segments(proto::TableDescriptor &table,
+                           const std::vector<proto::TableSegment> &segments) {
+  for (const proto::TableSegment &segment : segments) {
+    table.add_segments()->CopyFrom(segment);
+  }
+  // Timestamps have a resolution of seconds, so make sure this one differs
+  i64 timestamp =
+      std::chrono::duration_cast<std::chrono::seconds>(now().time_since_epoch())
+          .count();
+  table.set_timestamp(std::max(timestamp, table.timestamp() + 1));
+}
+
+Result compact_tables(storehouse::StorageConfig *storage_config,
+                      const std::string &db_path,
+                      const std::vector<std::string> &table_names) {
+  Result result;
+  result.set_success(true);
+
+  internal::set_database_path(db_path);
+
+  std::unique_ptr<storehouse::StorageBackend> storage{
+      storehouse::StorageBackend::make_from_config(storage_config)};
+
+  DatabaseMetadata meta =
+      read_database_metadata(storage.get(), DatabaseMetadata::descriptor_path());
+  for (const std::string &table_name : table_names) {
+    if (!meta.has_table(table_name)) {
+      RESULT_ERROR(&result, "Table %s does not exist.", table_name.c_str());
+      break;
+    }
+    i32 table_id = meta.get_table_id(table_name);
+    TableMetadata table_meta = read_table_metadata(
+        storage.get(), TableMetadata::descriptor_path(table_id));
+    proto::TableDescriptor table_desc = table_meta.get_descriptor();
+    if (table_desc.segments_size() > 0) {
+      VLOG(1) << "Table " << table_name << " is already compacted";
+      continue;
+    }
+    bool has_video = false;
+    for (const proto::Column &column : table_meta.columns()) {
+      has_video |= column.type() == ColumnType::Video;
+    }
+    if (has_video) {
+      RESULT_ERROR(&result, "Table %s stores video and can not be compacted.",
+                   table_name.c_str());
+      break;
+    }
+
+    std::vector<proto::TableSegment> segments;
+    std::vector<std::string> column_paths;
+    std::unique_ptr<SegmentWriter> writer;
+    i32 num_items = table_desc.end_rows_size();
+    for (i32 item_id = 0; item_id < num_items; ++item_id) {
+      if (!writer) {
+        writer.reset(new SegmentWriter(storage.get(), table_id,
+                                       "c" + std::to_string(segments.size())));
+      }
+      for (const proto::Column &column : table_meta.columns()) {
+        std::string path = table_item_output_path(table_id, column.id(),
+                                                  item_id);
+        std::unique_ptr<RandomReadFile> file;
+        BACKOFF_FAIL(
+            storehouse::make_unique_random_read_file(storage.get(), path, file));
+        u64 pos = 0;
+        std::vector<u8> data = storehouse::read_entire_file(file.get(), pos);
+        writer->add_column_file(item_id, column.id(), data.data(),
+                                data.size());
+        column_paths.push_back(path);
+      }
+      if (writer->size() >= TABLE_SEGMENT_SIZE || item_id == num_items - 1) {
+        segments.push_back(writer->finish());
+        writer.reset();
+      }
+    }
+
+    // Readers switch to the segments once the descriptor lists them, so the
+    // column files can only be removed afterwards
+    record_table_segments(table_desc, segments);
+    write_table_metadata(storage.get(), TableMetadata(table_desc));
+    for (const std::string &path : column_paths) {
+      StoreResult delete_result = storage->delete_file(path);
+      LOG_IF(WARNING, delete_result != StoreResult::Success)
+          << "Could not remove compacted column file " << path;
+    }
+    VLOG(1) << "Compacted " << column_paths.size() << " column files of table "
+            << table_name << " into " << segments.size() << " segments";
+  }
+  return result;
+}
+
+}
+}
@@ -0,0 +1,132 @@
+/* Copyright 2016 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "scanner/engine/db.h"
+#include "scanner/engine/runtime.h"
+#include "scanner/util/bounded_queue.h"
+#include "scanner/util/common.h"
+
+#include "storehouse/storage_backend.h"
+#include "storehouse/storage_config.h"
+
+#include <functional>
+#include <future>
+#include <map>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace scanner {
+namespace internal {
+
+///////////////////////////////////////////////////////////////////////////////
+/// Table segments
+///
+/// A segment packs the columns of many items of a table into one file so
+/// that large tables do not turn into millions of small objects. The column
+/// of an item is stored exactly as its column file would be, and the file
+/// ends with an index of SegmentIndexEntry, the number of entries and
+/// SEGMENT_FILE_MAGIC. Which items a segment holds is recorded in the
+/// TableDescriptor.
+const u64 SEGMENT_FILE_MAGIC = 0x31474553524e4353;  // "SCNRSEG1"
+
+struct SegmentIndexEntry {
+  i64 item_id;
+  i64 column_id;
+  u64 offset;
+  u64 size;
+};
+
+// Maps (item id, column id) to the offset and size of the column in the
+// segment
+using SegmentIndex = std::map<std::tuple<i64, i64>, std::tuple<u64, u64>>;
+
+SegmentIndex read_segment_index(storehouse::RandomReadFile *file,
+                                u64 file_size);
+
+// Size of rows in the column file layout
+u64 column_file_size(const std::vector<Row> &rows);
+
+// Lays rows out in the column file layout at buffer, which must hold
+// column_file_size(rows) bytes
+void stage_column_file(const std::vector<Row> &rows, u8 *buffer);
+
+// Threads which lay out large columns while a segment writer lays out the
+// rest. Owned by whoever creates the writers so that the threads outlive
+// individual segments.
+class StagingPool {
+ public:
+  using Task = std::packaged_task<void()>;
+
+  StagingPool(i32 num_threads);
+  ~StagingPool();
+
+  std::future<void> submit(std::function<void()> fn);
+
+ private:
+  void run();
+
+  BoundedQueue<Task> tasks_;
+  std::vector<std::thread> threads_;
+};
+
+class SegmentWriter {
+ public:
+  // Large columns are laid out on staging_pool if one is given
+  SegmentWriter(storehouse::StorageBackend *storage, i32 table_id,
+                const std::string &name, StagingPool *staging_pool = nullptr);
+  ~SegmentWriter();
+
+  u64 size() const { return size_; }
+
+  // Appends the columns of an item, with the column id being the index, in a
+  // single write. Large columns are laid out in parallel.
+  void add_columns(i64 item_id, const std::vector<RowList> &columns);
+
+  // Appends a column already in the column file layout
+  void add_column_file(i64 item_id, i64 column_id, const u8 *data,
+                       size_t size);
+
+  // Writes the index and saves the file
+  proto::TableSegment finish();
+
+ private:
+  void add_entry(i64 item_id, i64 column_id, u64 size);
+
+  std::unique_ptr<storehouse::WriteFile> file_;
+  StagingPool *staging_pool_;
+  // Reused across items to stage their columns
+  std::vector<u8> staging_;
+  proto::TableSegment segment_;
+  std::vector<SegmentIndexEntry> index_;
+  u64 size_ = 0;
+};
+
+// Adds segments to a table and moves its timestamp forward so that nodes
+// caching the table notice the change
+void record_table_segments(proto::TableDescriptor &table,
+                           const std::vector<proto::TableSegment> &segments);
+
+// Packs the column files of existing tables into segments and removes the
+// column files
+Result compact_tables(storehouse::StorageConfig *storage_config,
+                      const std::string &db_path,
+                      const std::vector<std::string> &table_names);
+
+}
+}
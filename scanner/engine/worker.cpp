@@ -18,10 +18,14 @@
 #include "scanner/engine/kernel_registry.h"
 #include "scanner/engine/load_worker.h"
 #include "scanner/engine/save_worker.h"
+#include "scanner/video/video_decoder.h"
 
 #include <grpc/support/log.h>
 #include <grpc/grpc_posix.h>
 
+#include <algorithm>
+#include <deque>
+
 using storehouse::StoreResult;
 using storehouse::WriteFile;
 using storehouse::RandomReadFile;
@@ -34,8 +38,10 @@ inline bool operator==(const MemoryPoolConfig &lhs,
                        const MemoryPoolConfig &rhs) {
   return (lhs.cpu().use_pool() == rhs.cpu().use_pool()) &&
          (lhs.cpu().free_space() == rhs.cpu().free_space()) &&
+         (lhs.cpu().max_recycled_bytes() == rhs.cpu().max_recycled_bytes()) &&
          (lhs.gpu().use_pool() == rhs.gpu().use_pool()) &&
-         (lhs.gpu().free_space() == rhs.gpu().free_space());
+         (lhs.gpu().free_space() == rhs.gpu().free_space()) &&
+         (lhs.gpu().max_recycled_bytes() == rhs.gpu().max_recycled_bytes());
 }
 inline bool operator!=(const MemoryPoolConfig &lhs,
                        const MemoryPoolConfig &rhs) {
@@ -178,6 +184,82 @@ void analyze_dag(
     }
   }
 }
+
+bool reads_input_column(const proto::Op &op, const std::string &column) {
+  for (auto &input : op.inputs()) {
+    if (input.op_index() != 0) {
+      continue;
+    }
+    for (const std::string &col : input.columns()) {
+      if (col == column) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Picks the cheapest frame format that every op reading decoded frames from
+// the input table accepts. kernel_factories is indexed like ops without the
+// InputTable op.
+FrameFormat choose_frame_format(
+    const proto::TaskSet &task_set,
+    const std::vector<KernelFactory *> &kernel_factories) {
+  // Ordered from cheapest to produce
+  std::vector<FrameFormat> candidates = {FrameFormat::GRAY8, FrameFormat::I420,
+                                         FrameFormat::NV12, FrameFormat::RGB24};
+  auto &ops = task_set.ops();
+  for (i32 op_index = 1; op_index < ops.size(); ++op_index) {
+    if (!reads_input_column(ops.Get(op_index), frame_column_name())) {
+      continue;
+    }
+    // Frames written to the output table are stored as RGB
+    if (op_index == ops.size() - 1) {
+      return FrameFormat::RGB24;
+    }
+    const std::vector<FrameFormat> &accepted =
+        kernel_factories[op_index - 1]->get_frame_formats();
+    std::vector<FrameFormat> remaining;
+    for (FrameFormat f : candidates) {
+      if (std::find(accepted.begin(), accepted.end(), f) != accepted.end()) {
+        remaining.push_back(f);
+      }
+    }
+    candidates = remaining;
+  }
+  return candidates.empty() ? FrameFormat::RGB24 : candidates[0];
+}
+
+// Computes the largest frame size needed by the ops reading decoded frames or
+// their frame info from the input table. Returns 0 for a dimension that can
+// not be shrunk.
+std::tuple<i32, i32> choose_max_frame_size(
+    const proto::TaskSet &task_set,
+    const std::vector<KernelFactory *> &kernel_factories,
+    const std::vector<Kernel::Config> &kernel_configs) {
+  i32 max_width = -1;
+  i32 max_height = -1;
+  auto &ops = task_set.ops();
+  for (i32 op_index = 1; op_index < ops.size(); ++op_index) {
+    auto &op = ops.Get(op_index);
+    if (!reads_input_column(op, frame_column_name()) &&
+        !reads_input_column(op, frame_info_column_name())) {
+      continue;
+    }
+    if (op_index == ops.size() - 1 ||
+        !kernel_factories[op_index - 1]->has_max_frame_size()) {
+      return std::make_tuple(0, 0);
+    }
+    i32 width, height;
+    std::tie(width, height) =
+        kernel_factories[op_index - 1]->get_max_frame_size(
+            kernel_configs[op_index - 1]);
+    max_width = (width <= 0 || max_width == 0) ? 0 : std::max(max_width, width);
+    max_height =
+        (height <= 0 || max_height == 0) ? 0 : std::max(max_height, height);
+  }
+  return std::make_tuple(std::max(max_width, 0), std::max(max_height, 0));
+}
 }
 
 class WorkerImpl final : public proto::Worker::Service {
@@ -215,6 +297,14 @@ public:
 
     storage_ =
         storehouse::StorageBackend::make_from_config(db_params_.storage_config);
+    // Read ahead threads use the metadata cache slots after the load workers
+    metadata_cache_.reset(new MetadataCache(
+        db_params_.storage_config,
+        db_params_.num_load_workers + db_params_.num_load_io_threads));
+    if (db_params_.num_load_io_threads > 0) {
+      read_ahead_pool_.reset(new ReadAheadPool(db_params_.num_load_workers,
+                                               db_params_.num_load_io_threads));
+    }
   }
 
   ~WorkerImpl() {
@@ -362,6 +452,20 @@ public:
     i32 num_kernel_groups = static_cast<i32>(kernel_groups.size());
     assert(num_kernel_groups > 0); // is this actually necessary?
 
+    // The hardware decoders only produce full size RGB frames
+    FrameFormat frame_format = FrameFormat::RGB24;
+    i32 max_frame_width = 0;
+    i32 max_frame_height = 0;
+    if (!(kernel_factories[0]->get_device_type() == DeviceType::GPU &&
+          VideoDecoder::has_decoder_type(VideoDecoderType::NVIDIA))) {
+      frame_format =
+          choose_frame_format(job_params->task_set(), kernel_factories);
+      std::tie(max_frame_width, max_frame_height) = choose_max_frame_size(
+          job_params->task_set(), kernel_factories, kernel_configs);
+    }
+    VLOG(1) << "Decoding frames as " << FrameFormat_Name(frame_format)
+            << " of at most " << max_frame_width << "x" << max_frame_height;
+
     i32 pipeline_instances_per_node = job_params->pipeline_instances_per_node();
     // If ki per node is -1, we set a smart default. Currently, we calculate the
     // maximum possible kernel instances without oversubscribing any part of the
@@ -425,27 +529,48 @@ public:
     }
 
 
-    // Load table metadata for use in constructing io items
+    // The master sends the metadata of the tables this job touches
     DatabaseMetadata meta =
         read_database_metadata(storage_, DatabaseMetadata::descriptor_path());
-    std::map<std::string, TableMetadata> table_meta;
-    for (const std::string &table_name : meta.table_names()) {
-      std::string table_path =
-          TableMetadata::descriptor_path(meta.get_table_id(table_name));
-      table_meta[table_name] = read_table_metadata(storage_, table_path);
+    std::vector<TableMetadata> table_metas;
+    for (auto &table_desc : job_params->table_descriptors()) {
+      table_metas.emplace_back(table_desc);
     }
+    metadata_cache_->update_tables(table_metas);
 
     // Setup shared resources for distributing work to processing threads
     i64 accepted_items = 0;
-    Queue<std::tuple<IOItem, LoadWorkEntry>> load_work;
-    Queue<std::tuple<IOItem, EvalWorkEntry>> initial_eval_work;
-    std::vector<std::vector<Queue<std::tuple<IOItem, EvalWorkEntry>>>>
+    auto queue_size = [](i32 configured) {
+      return configured > 0 ? configured : DEFAULT_WORK_QUEUE_SIZE;
+    };
+    i32 eval_queue_size = queue_size(job_params->eval_queue_size());
+    BoundedQueue<std::tuple<IOItem, LoadWorkEntry>> load_work(
+        queue_size(job_params->load_queue_size()));
+    BoundedQueue<std::tuple<IOItem, EvalWorkEntry>> initial_eval_work(
+        queue_size(job_params->pre_eval_queue_size()));
+    std::vector<std::vector<
+        std::unique_ptr<BoundedQueue<std::tuple<IOItem, EvalWorkEntry>>>>>
         eval_work(pipeline_instances_per_node);
-    Queue<std::tuple<IOItem, EvalWorkEntry>> save_work;
-    std::atomic<i64> retired_items{0};
+    BoundedQueue<std::tuple<IOItem, EvalWorkEntry>> save_work(
+        queue_size(job_params->save_queue_size()));
+    WorkerMonitor monitor;
+
+    // Decoded frames are shared across the pipeline instances of this node
+    std::unique_ptr<DecodedFrameCache> frame_cache;
+    if (job_params->frame_cache_size() > 0) {
+      frame_cache.reset(new DecodedFrameCache(job_params->frame_cache_size()));
+    }
 
     // Setup load workers
     i32 num_load_workers = db_params_.num_load_workers;
+    i32 prefetch_items = job_params->load_prefetch_items() != 0
+                             ? std::max(job_params->load_prefetch_items(), 0)
+                             : DEFAULT_LOAD_PREFETCH_ITEMS;
+    i64 prefetch_bytes = job_params->load_prefetch_bytes() > 0
+                             ? job_params->load_prefetch_bytes()
+                             : DEFAULT_LOAD_PREFETCH_BYTES;
+    ReadAheadPool *read_ahead_pool =
+        prefetch_items > 0 ? read_ahead_pool_.get() : nullptr;
     std::vector<Profiler> load_thread_profilers(num_load_workers,
                                                 Profiler(base_time));
     std::vector<LoadThreadArgs> load_thread_args;
@@ -453,10 +578,12 @@ public:
       // Create IO thread for reading and decoding data
       load_thread_args.emplace_back(LoadThreadArgs{
           // Uniform arguments
-          node_id_, job_params,
+          node_id_, job_params, frame_format, max_frame_width,
+          max_frame_height, metadata_cache_.get(), read_ahead_pool,
+          prefetch_items, prefetch_bytes,
 
           // Per worker arguments
-          i, db_params_.storage_config, load_thread_profilers[i],
+          i, load_thread_profilers[i],
 
           // Queues
           load_work, initial_eval_work,
@@ -481,11 +608,17 @@ public:
     i32 next_cpu_num = 0;
     i32 next_gpu_idx = db_params_.gpu_ids.size() / local_total * local_id;
     for (i32 ki = 0; ki < pipeline_instances_per_node; ++ki) {
-      std::vector<Queue<std::tuple<IOItem, EvalWorkEntry>>> &work_queues =
-          eval_work[ki];
+      std::vector<
+          std::unique_ptr<BoundedQueue<std::tuple<IOItem, EvalWorkEntry>>>>
+          &work_queues = eval_work[ki];
       std::vector<Profiler> &eval_thread_profilers = eval_profilers[ki];
       std::vector<proto::Result>& results = eval_results[ki];
-      work_queues.resize(num_kernel_groups - 1 + 2); // +2 for pre/post
+      // +2 for pre/post
+      for (i32 i = 0; i < num_kernel_groups - 1 + 2; ++i) {
+        work_queues.emplace_back(
+            new BoundedQueue<std::tuple<IOItem, EvalWorkEntry>>(
+                eval_queue_size));
+      }
       results.resize(num_kernel_groups);
       for (auto& result : results) {
         result.set_success(true);
@@ -533,11 +666,11 @@ public:
         }
 
         // Input work queue
-        Queue<std::tuple<IOItem, EvalWorkEntry>> *input_work_queue =
-            &work_queues[kg];
+        BoundedQueue<std::tuple<IOItem, EvalWorkEntry>> *input_work_queue =
+            work_queues[kg].get();
         // Create new queue for output, reuse previous queue as input
-        Queue<std::tuple<IOItem, EvalWorkEntry>> *output_work_queue =
-            &work_queues[kg + 1];
+        BoundedQueue<std::tuple<IOItem, EvalWorkEntry>> *output_work_queue =
+            work_queues[kg + 1].get();
         // Create eval thread for passing data through neural net
         thread_args.emplace_back(EvaluateThreadArgs{
             // Uniform arguments
@@ -545,17 +678,17 @@ public:
 
             // Per worker arguments
             ki, kg, group, lc, dc, uo, cm, eval_thread_profilers[kg+1],
-            results[kg],
+            results[kg], monitor,
 
             // Queues
             *input_work_queue, *output_work_queue});
       }
       // Pre evaluate worker
       {
-        Queue<std::tuple<IOItem, EvalWorkEntry>> *input_work_queue =
+        BoundedQueue<std::tuple<IOItem, EvalWorkEntry>> *input_work_queue =
             &initial_eval_work;
-        Queue<std::tuple<IOItem, EvalWorkEntry>> *output_work_queue =
-            &work_queues[0];
+        BoundedQueue<std::tuple<IOItem, EvalWorkEntry>> *output_work_queue =
+            work_queues[0].get();
         assert(kernel_groups.size() > 0);
         pre_eval_args.emplace_back(PreEvaluateThreadArgs{
             // Uniform arguments
@@ -563,6 +696,7 @@ public:
 
             // Per worker arguments
               ki, first_kernel_type, eval_thread_profilers.front(),
+              frame_cache.get(),
 
             // Queues
             *input_work_queue, *output_work_queue});
@@ -570,9 +704,9 @@ public:
 
       // Post evaluate worker
       {
-        Queue<std::tuple<IOItem, EvalWorkEntry>> *input_work_queue =
-            &work_queues.back();
-        Queue<std::tuple<IOItem, EvalWorkEntry>> *output_work_queue =
+        BoundedQueue<std::tuple<IOItem, EvalWorkEntry>> *input_work_queue =
+            work_queues.back().get();
+        BoundedQueue<std::tuple<IOItem, EvalWorkEntry>> *output_work_queue =
             &save_work;
         post_eval_args.emplace_back(
             PostEvaluateThreadArgs{// Uniform arguments
@@ -609,6 +743,8 @@ public:
     i32 num_save_workers = db_params_.num_save_workers;
     std::vector<Profiler> save_thread_profilers(num_save_workers,
                                                 Profiler(base_time));
+    std::vector<std::vector<proto::WrittenSegment>> save_segments(
+        num_save_workers);
     std::vector<SaveThreadArgs> save_thread_args;
     for (i32 i = 0; i < num_save_workers; ++i) {
       // Create IO thread for reading and decoding data
@@ -620,7 +756,9 @@ public:
                          i, db_params_.storage_config, save_thread_profilers[i],
 
                          // Queues
-                         save_work, retired_items});
+                         save_work, monitor,
+
+                         save_segments[i]});
     }
     std::vector<pthread_t> save_threads(num_save_workers);
     for (i32 i = 0; i < num_save_workers; ++i) {
@@ -629,59 +767,126 @@ public:
 
     timepoint_t start_time = now();
 
+    // Work is leased from the master in batches. The next lease is requested
+    // asynchronously once the current one is half consumed so the pipeline
+    // does not stall on a master round-trip for every io item.
+    i32 lease_size = pipeline_instances_per_node * TASKS_IN_QUEUE_PER_PU;
+    std::deque<proto::NewWork> leased_work;
+    grpc::CompletionQueue lease_cq;
+    std::unique_ptr<grpc::ClientContext> lease_context;
+    proto::NewWorkBatch lease_reply;
+    grpc::Status lease_status;
+    bool lease_in_flight = false;
+    bool master_out_of_work = false;
+
+    auto request_lease = [&]() {
+      proto::NodeInfo node_info;
+      node_info.set_node_id(node_id_);
+      node_info.set_max_items(lease_size);
+      lease_context.reset(new grpc::ClientContext);
+      lease_reply.Clear();
+      std::unique_ptr<grpc::ClientAsyncResponseReader<proto::NewWorkBatch>> rpc(
+          master_->AsyncNextWorkBatch(lease_context.get(), node_info,
+                                      &lease_cq));
+      rpc->Finish(&lease_reply, &lease_status, (void *)1);
+      lease_in_flight = true;
+    };
+
+    // Returns false if the lease could not be retrieved from the master
+    auto collect_lease = [&](bool block) {
+      void *got_tag;
+      bool ok = false;
+      if (block) {
+        GPR_ASSERT(lease_cq.Next(&got_tag, &ok));
+      } else {
+        auto status = lease_cq.AsyncNext(&got_tag, &ok,
+                                         std::chrono::system_clock::now());
+        if (status != grpc::CompletionQueue::GOT_EVENT) {
+          return true;
+        }
+      }
+      lease_in_flight = false;
+      if (!ok || !lease_status.ok()) {
+        return false;
+      }
+      if (lease_reply.work_size() == 0) {
+        // No more work left
+        VLOG(1) << "Node " << node_id_ << " received done signal.";
+        master_out_of_work = true;
+      }
+      for (auto &work : *lease_reply.mutable_work()) {
+        leased_work.emplace_back();
+        leased_work.back().Swap(&work);
+      }
+      return true;
+    };
+
     // Monitor amount of work left and request more when running low
+    request_lease();
     while (true) {
-      i32 local_work = accepted_items - retired_items;
-      if (local_work < pipeline_instances_per_node * TASKS_IN_QUEUE_PER_PU) {
-        grpc::ClientContext context;
-        proto::NodeInfo node_info;
-        proto::NewWork new_work;
-
-        node_info.set_node_id(node_id_);
-        grpc::Status status =
-            master_->NextWork(&context, node_info, &new_work);
-        if (!status.ok()) {
-          RESULT_ERROR(job_result,
-                       "Worker %d could not get next work from master",
-                       node_id_);
-          break;
-        }
+      if (lease_in_flight && !collect_lease(leased_work.empty())) {
+        RESULT_ERROR(job_result,
+                     "Worker %d could not get next work from master",
+                     node_id_);
+        break;
+      }
+      if (!lease_in_flight && !master_out_of_work &&
+          (i32)leased_work.size() <= lease_size / 2) {
+        request_lease();
+      }
 
-        i32 next_item = new_work.io_item().item_id();
-        if (next_item == -1) {
-          // No more work left
-          VLOG(1) << "Node " << node_id_ << " received done signal.";
-          break;
-        } else {
-          load_work.push(
-              std::make_tuple(new_work.io_item(), new_work.load_work()));
-          accepted_items++;
-        }
+      i32 local_work = accepted_items - monitor.retired_items;
+      while (local_work < lease_size && !leased_work.empty()) {
+        proto::NewWork &new_work = leased_work.front();
+        load_work.push(
+            std::make_tuple(new_work.io_item(), new_work.load_work()));
+        leased_work.pop_front();
+        accepted_items++;
+        local_work++;
+      }
+      if (master_out_of_work && leased_work.empty()) {
+        break;
       }
 
-      for (size_t i = 0; i < eval_results.size(); ++i) {
-        for (size_t j = 0; j < eval_results[i].size(); ++j) {
-          auto &result = eval_results[i][j];
-          if (!result.success()) {
-            LOG(WARNING) << "(N/KI/KG: " << node_id_ << "/" << i << "/" << j
-                         << ") returned error result: " << result.msg();
-            goto leave_loop;
+      if (monitor.error) {
+        for (size_t i = 0; i < eval_results.size(); ++i) {
+          for (size_t j = 0; j < eval_results[i].size(); ++j) {
+            auto &result = eval_results[i][j];
+            if (!result.success()) {
+              LOG(WARNING) << "(N/KI/KG: " << node_id_ << "/" << i << "/"
+                           << j << ") returned error result: " << result.msg();
+            }
           }
         }
+        goto leave_loop;
       }
       goto remain_loop;
     leave_loop:
       break;
     remain_loop:
 
-      std::this_thread::yield();
+      // With nothing buffered locally the next iteration blocks on the
+      // outstanding lease. Otherwise sleep until the lookahead has room for
+      // more items or a kernel group failed.
+      if (!leased_work.empty()) {
+        std::unique_lock<std::mutex> lk(monitor.mutex);
+        monitor.cv.wait(lk, [&] {
+          return accepted_items - monitor.retired_items < lease_size ||
+                 monitor.error;
+        });
+      }
+    }
+    // Do not tear down the completion queue with a lease still outstanding
+    if (lease_in_flight) {
+      lease_context->TryCancel();
+      collect_lease(true);
     }
 
     // Push sentinel work entries into queue to terminate load threads
     for (i32 i = 0; i < num_load_workers; ++i) {
       LoadWorkEntry entry;
       entry.set_io_item_index(-1);
-      load_work.push(std::make_tuple(IOItem{}, entry));
+      load_work.push(std::make_tuple(IOItem{}, std::move(entry)));
     }
 
     for (i32 i = 0; i < num_load_workers; ++i) {
@@ -696,7 +901,7 @@ public:
     for (i32 i = 0; i < pipeline_instances_per_node; ++i) {
       EvalWorkEntry entry;
       entry.io_item_index = -1;
-      initial_eval_work.push(std::make_tuple(IOItem{}, entry));
+      initial_eval_work.push(std::make_tuple(IOItem{}, std::move(entry)));
     }
 
     for (i32 i = 0; i < pipeline_instances_per_node; ++i) {
@@ -711,7 +916,7 @@ public:
       for (i32 pu = 0; pu < pipeline_instances_per_node; ++pu) {
         EvalWorkEntry entry;
         entry.io_item_index = -1;
-        eval_work[pu][kg].push(std::make_tuple(IOItem{}, entry));
+        eval_work[pu][kg]->push(std::make_tuple(IOItem{}, std::move(entry)));
       }
       for (i32 pu = 0; pu < pipeline_instances_per_node; ++pu) {
         // Wait until eval has finished
@@ -726,7 +931,7 @@ public:
     for (i32 pu = 0; pu < pipeline_instances_per_node; ++pu) {
       EvalWorkEntry entry;
       entry.io_item_index = -1;
-      eval_work[pu].back().push(std::make_tuple(IOItem{}, entry));
+      eval_work[pu].back()->push(std::make_tuple(IOItem{}, std::move(entry)));
     }
     for (i32 pu = 0; pu < pipeline_instances_per_node; ++pu) {
       // Wait until eval has finished
@@ -740,7 +945,7 @@ public:
     for (i32 i = 0; i < num_save_workers; ++i) {
       EvalWorkEntry entry;
       entry.io_item_index = -1;
-      save_work.push(std::make_tuple(IOItem{}, entry));
+      save_work.push(std::make_tuple(IOItem{}, std::move(entry)));
     }
 
     for (i32 i = 0; i < num_save_workers; ++i) {
@@ -751,6 +956,40 @@ public:
       free(result);
     }
 
+    // The master records the segments in the descriptors of the output tables
+    for (auto &segments : save_segments) {
+      for (proto::WrittenSegment &segment : segments) {
+        job_result->add_segments()->Swap(&segment);
+      }
+    }
+
+    if (frame_cache) {
+      VLOG(1) << "Node " << node_id_ << " decoded frame cache: "
+              << frame_cache->hits() << " hits, " << frame_cache->misses()
+              << " misses";
+    }
+    VLOG(1) << "Node " << node_id_ << " metadata cache: "
+            << metadata_cache_->hits() << " hits, "
+            << metadata_cache_->misses() << " misses";
+
+    // Report pool usage so the pool sizes for later jobs can be tuned
+    std::vector<DeviceHandle> pool_devices = {CPU_DEVICE};
+    for (i32 gpu_id : db_params_.gpu_ids) {
+      pool_devices.push_back({DeviceType::GPU, gpu_id});
+    }
+    for (DeviceHandle device : pool_devices) {
+      MemoryPoolStats stats = memory_pool_stats(device);
+      if (stats.pool_size == 0) {
+        continue;
+      }
+      LOG(INFO) << "Node " << node_id_ << " " << device << " memory pool: "
+                << stats.peak_allocated_bytes << " of " << stats.pool_size
+                << " bytes at peak, " << stats.allocated_bytes
+                << " bytes still allocated, " << stats.num_slabs
+                << " small object slabs, fragmentation "
+                << stats.fragmentation;
+    }
+
 // Ensure all files are flushed
 #ifdef SCANNER_PROFILING
     std::fflush(NULL);
@@ -855,6 +1094,9 @@ private:
   i32 node_id_;
   storehouse::StorageBackend *storage_;
   std::map<std::string, TableMetadata *> table_metas_;
+  std::unique_ptr<MetadataCache> metadata_cache_;
+  // Declared after the cache so its threads stop before the cache goes away
+  std::unique_ptr<ReadAheadPool> read_ahead_pool_;
   bool memory_pool_initialized_ = false;
   MemoryPoolConfig cached_memory_pool_config_;
 };
@@ -0,0 +1,80 @@
+/* Copyright 2016 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "scanner/util/common.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <type_traits>
+
+namespace scanner {
+
+// Bounded multi-producer multi-consumer queue backed by a ring buffer of
+// sequenced cells. Pushes and pops do not take a lock while the queue is
+// neither full nor empty. Blocking calls spin briefly and then park on a
+// condition variable which is only signaled when a thread is parked.
+template <typename T>
+class BoundedQueue {
+ public:
+  // Capacity is rounded up to the next power of two
+  BoundedQueue(i32 capacity = 4);
+  ~BoundedQueue();
+
+  BoundedQueue(const BoundedQueue<T>&) = delete;
+  BoundedQueue<T>& operator=(const BoundedQueue<T>&) = delete;
+
+  i32 capacity() const;
+
+  // Approximate number of items in the queue
+  i32 size() const;
+
+  // Moves from item only if it was inserted
+  bool try_push(T&& item);
+
+  void push(T&& item);
+
+  bool try_pop(T& item);
+
+  void pop(T& item);
+
+ private:
+  static const i32 SPIN_ITERATIONS = 64;
+
+  struct Cell {
+    std::atomic<size_t> sequence;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+  };
+
+  void wake_poppers();
+  void wake_pushers();
+
+  size_t mask_;
+  Cell* cells_;
+  // Kept on separate cache lines so producers and consumers do not contend
+  alignas(64) std::atomic<size_t> enqueue_pos_;
+  alignas(64) std::atomic<size_t> dequeue_pos_;
+
+  alignas(64) std::mutex park_mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  std::atomic<i32> pop_waiters_{0};
+  std::atomic<i32> push_waiters_{0};
+};
+}
+
+#include "bounded_queue.inl"
@@ -0,0 +1,173 @@
+/* Copyright 2016 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bounded_queue.h"
+
+#include <thread>
+
+namespace scanner {
+
+template <typename T>
+BoundedQueue<T>::BoundedQueue(i32 capacity) {
+  size_t size = 2;
+  while (size < (size_t)capacity) {
+    size <<= 1;
+  }
+  mask_ = size - 1;
+  cells_ = new Cell[size];
+  for (size_t i = 0; i < size; ++i) {
+    cells_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  enqueue_pos_.store(0, std::memory_order_relaxed);
+  dequeue_pos_.store(0, std::memory_order_relaxed);
+}
+
+template <typename T>
+BoundedQueue<T>::~BoundedQueue() {
+  T item;
+  while (try_pop(item)) {
+  }
+  delete[] cells_;
+}
+
+template <typename T>
+i32 BoundedQueue<T>::capacity() const {
+  return mask_ + 1;
+}
+
+template <typename T>
+i32 BoundedQueue<T>::size() const {
+  size_t enqueued = enqueue_pos_.load(std::memory_order_relaxed);
+  size_t dequeued = dequeue_pos_.load(std::memory_order_relaxed);
+  return enqueued > dequeued ? (i32)(enqueued - dequeued) : 0;
+}
+
+template <typename T>
+bool BoundedQueue<T>::try_push(T&& item) {
+  Cell* cell;
+  size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+  while (true) {
+    cell = &cells_[pos & mask_];
+    size_t seq = cell->sequence.load(std::memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+    if (diff == 0) {
+      if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                             std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // Full
+      return false;
+    } else {
+      pos = enqueue_pos_.load(std::memory_order_relaxed);
+    }
+  }
+  new (&cell->storage) T(std::move(item));
+  cell->sequence.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+template <typename T>
+bool BoundedQueue<T>::try_pop(T& item) {
+  Cell* cell;
+  size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+  while (true) {
+    cell = &cells_[pos & mask_];
+    size_t seq = cell->sequence.load(std::memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+    if (diff == 0) {
+      if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+                                             std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // Empty
+      return false;
+    } else {
+      pos = dequeue_pos_.load(std::memory_order_relaxed);
+    }
+  }
+  T* stored = reinterpret_cast<T*>(&cell->storage);
+  item = std::move(*stored);
+  stored->~T();
+  cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+  return true;
+}
+
+template <typename T>
+void BoundedQueue<T>::push(T&& item) {
+  for (i32 i = 0; i < SPIN_ITERATIONS; ++i) {
+    if (try_push(std::move(item))) {
+      wake_poppers();
+      return;
+    }
+    std::this_thread::yield();
+  }
+
+  std::unique_lock<std::mutex> lock(park_mutex_);
+  push_waiters_++;
+  // Pairs with the fence in wake_pushers so that either we observe the free
+  // cell or the popper observes us waiting
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  while (!try_push(std::move(item))) {
+    not_full_.wait(lock);
+  }
+  push_waiters_--;
+  lock.unlock();
+  wake_poppers();
+}
+
+template <typename T>
+void BoundedQueue<T>::pop(T& item) {
+  for (i32 i = 0; i < SPIN_ITERATIONS; ++i) {
+    if (try_pop(item)) {
+      wake_pushers();
+      return;
+    }
+    std::this_thread::yield();
+  }
+
+  std::unique_lock<std::mutex> lock(park_mutex_);
+  pop_waiters_++;
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  while (!try_pop(item)) {
+    not_empty_.wait(lock);
+  }
+  pop_waiters_--;
+  lock.unlock();
+  wake_pushers();
+}
+
+template <typename T>
+void BoundedQueue<T>::wake_poppers() {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (pop_waiters_.load(std::memory_order_relaxed) > 0) {
+    // Taking the lock guarantees the waiter is either inside wait() or has
+    // not yet re-checked the queue, so the notification can not be lost
+    std::unique_lock<std::mutex> lock(park_mutex_);
+    not_empty_.notify_one();
+  }
+}
+
+template <typename T>
+void BoundedQueue<T>::wake_pushers() {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (push_waiters_.load(std::memory_order_relaxed) > 0) {
+    std::unique_lock<std::mutex> lock(park_mutex_);
+    not_full_.notify_one();
+  }
+}
+
+}
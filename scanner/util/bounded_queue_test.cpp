@@ -0,0 +1,147 @@
+/* Copyright 2016 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/util/bounded_queue.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace scanner {
+namespace {
+// Long enough for a blocked call to give up spinning and park
+const std::chrono::milliseconds PARK_DELAY(50);
+}
+
+TEST(BoundedQueue, TryPushAndPopRespectCapacity) {
+  BoundedQueue<i32> queue(3);
+  ASSERT_EQ(queue.capacity(), 4);
+  for (i32 i = 0; i < 4; ++i) {
+    i32 item = i;
+    EXPECT_TRUE(queue.try_push(std::move(item)));
+  }
+  i32 extra = 4;
+  EXPECT_FALSE(queue.try_push(std::move(extra)));
+  EXPECT_EQ(queue.size(), 4);
+  for (i32 i = 0; i < 4; ++i) {
+    i32 item;
+    ASSERT_TRUE(queue.try_pop(item));
+    EXPECT_EQ(item, i);
+  }
+  i32 item;
+  EXPECT_FALSE(queue.try_pop(item));
+  EXPECT_EQ(queue.size(), 0);
+}
+
+TEST(BoundedQueue, PopBlocksUntilPush) {
+  BoundedQueue<i32> queue(2);
+  std::atomic<bool> popped{false};
+  i32 item = -1;
+  std::thread popper([&]() {
+    queue.pop(item);
+    popped = true;
+  });
+  std::this_thread::sleep_for(PARK_DELAY);
+  EXPECT_FALSE(popped);
+  queue.push(7);
+  popper.join();
+  EXPECT_TRUE(popped);
+  EXPECT_EQ(item, 7);
+}
+
+TEST(BoundedQueue, PushBlocksWhileFull) {
+  BoundedQueue<i32> queue(2);
+  queue.push(0);
+  queue.push(1);
+  std::atomic<bool> pushed{false};
+  std::thread pusher([&]() {
+    queue.push(2);
+    pushed = true;
+  });
+  std::this_thread::sleep_for(PARK_DELAY);
+  EXPECT_FALSE(pushed);
+  i32 item;
+  queue.pop(item);
+  EXPECT_EQ(item, 0);
+  pusher.join();
+  EXPECT_TRUE(pushed);
+  queue.pop(item);
+  EXPECT_EQ(item, 1);
+  queue.pop(item);
+  EXPECT_EQ(item, 2);
+}
+
+TEST(BoundedQueue, SentinelsWakeParkedConsumers) {
+  // Pipeline threads shut down by popping a sentinel, so every parked
+  // consumer has to be woken by one push each
+  const i32 num_consumers = 8;
+  const i32 items_per_producer = 10000;
+  BoundedQueue<i32> queue(16);
+  std::atomic<i64> sum{0};
+  std::vector<std::thread> consumers;
+  for (i32 c = 0; c < num_consumers; ++c) {
+    consumers.emplace_back([&]() {
+      while (true) {
+        i32 item;
+        queue.pop(item);
+        if (item < 0) {
+          break;
+        }
+        sum += item;
+      }
+    });
+  }
+  std::this_thread::sleep_for(PARK_DELAY);
+
+  std::vector<std::thread> producers;
+  for (i32 p = 0; p < 2; ++p) {
+    producers.emplace_back([&]() {
+      for (i32 i = 1; i <= items_per_producer; ++i) {
+        i32 item = i;
+        queue.push(std::move(item));
+      }
+    });
+  }
+  for (std::thread &producer : producers) {
+    producer.join();
+  }
+  for (i32 c = 0; c < num_consumers; ++c) {
+    queue.push(-1);
+  }
+  for (std::thread &consumer : consumers) {
+    consumer.join();
+  }
+  i64 expected = (i64)items_per_producer * (items_per_producer + 1);
+  EXPECT_EQ(sum, expected);
+  EXPECT_EQ(queue.size(), 0);
+}
+
+TEST(BoundedQueue, DestructorReleasesQueuedItems) {
+  std::shared_ptr<i32> shared = std::make_shared<i32>(0);
+  {
+    BoundedQueue<std::shared_ptr<i32>> queue(4);
+    for (i32 i = 0; i < 3; ++i) {
+      std::shared_ptr<i32> copy = shared;
+      queue.push(std::move(copy));
+    }
+    EXPECT_EQ(shared.use_count(), 4);
+  }
+  EXPECT_EQ(shared.use_count(), 1);
+}
+}
@@ -73,8 +73,37 @@ std::string image_encoding_type_to_string(ImageEncodingType t) {
   return s;
 }
 
+size_t frame_buffer_size(i32 width, i32 height, FrameFormat format) {
+  size_t pixels = static_cast<size_t>(width) * height;
+  // Chroma planes of 4:2:0 formats round up for odd dimensions
+  size_t chroma = static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2);
+  size_t size = 0;
+  switch (format) {
+  case FrameFormat::RGB24:
+    size = pixels * 3;
+    break;
+  case FrameFormat::I420:
+    size = pixels + chroma * 2;
+    break;
+  case FrameFormat::NV12:
+    size = pixels + chroma * 2;
+    break;
+  case FrameFormat::GRAY8:
+    size = pixels;
+    break;
+  default:
+    assert(false);
+  }
+  return size;
+}
+
 i64 IO_ITEM_SIZE = 64;         // Number of rows to load and save at a time
 i64 WORK_ITEM_SIZE = 8;        // Max size of a work item
 i32 TASKS_IN_QUEUE_PER_PU = 4; // How many tasks per PU to allocate to a node
+i32 DEFAULT_WORK_QUEUE_SIZE = 4; // Capacity of queues between pipeline stages
+i32 MAX_OPEN_FILES_PER_LOAD_WORKER = 256; // Column files kept open per worker
+i32 DEFAULT_LOAD_PREFETCH_ITEMS = 2; // Io items read ahead per load worker
+i64 DEFAULT_LOAD_PREFETCH_BYTES = 512L * 1024L * 1024L; // Read ahead budget
+i64 TABLE_SEGMENT_SIZE = 256L * 1024L * 1024L; // Bytes packed into a segment
 i32 NUM_CUDA_STREAMS = 32;     // Number of cuda streams for image processing
 }
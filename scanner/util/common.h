@@ -41,6 +41,7 @@ using proto::DeviceType;
 using proto::ImageEncodingType;
 using proto::ImageColorSpace;
 using proto::ColumnType;
+using proto::FrameFormat;
 using proto::LoadWorkEntry;
 using proto::Column;
 using proto::MemoryPoolConfig;
@@ -100,6 +101,9 @@ struct StridedInterval {
 bool string_to_image_encoding_type(const std::string& s, proto::ImageEncodingType& t);
 std::string image_encoding_type_to_string(proto::ImageEncodingType d);
 
+// Bytes needed to hold a decoded frame of the given format
+size_t frame_buffer_size(i32 width, i32 height, proto::FrameFormat format);
+
 #define RESULT_ERROR(result__, str__, ...) {          \
     char errstr__[1024];                              \
     snprintf(errstr__, 1024, str__, ## __VA_ARGS__);  \
@@ -111,5 +115,10 @@ std::string image_encoding_type_to_string(proto::ImageEncodingType d);
 ///////////////////////////////////////////////////////////////////////////////
 /// Global constants
 extern i32 TASKS_IN_QUEUE_PER_PU;  // How many tasks per PU to allocate
+extern i32 DEFAULT_WORK_QUEUE_SIZE;  // Capacity of queues between stages
+extern i32 MAX_OPEN_FILES_PER_LOAD_WORKER;  // Column files kept open
+extern i32 DEFAULT_LOAD_PREFETCH_ITEMS;  // Io items read ahead per load worker
+extern i64 DEFAULT_LOAD_PREFETCH_BYTES;  // Bytes of read ahead items per node
+extern i64 TABLE_SEGMENT_SIZE;  // Bytes packed into a table segment
 extern i32 NUM_CUDA_STREAMS;  // # of cuda streams for image processing
 }
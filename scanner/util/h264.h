@@ -208,6 +208,9 @@ inline bool parse_sps(GetBitsState &gb, SPS& info) {
       get_se_golomb(gb);
     }
   } break;
+  case 2: {
+    // Display order follows decode order
+  } break;
   default: {
     LOG(WARNING) << "Illegal picture_order_count type: " << info.poc_type;
     return false;
@@ -16,8 +16,12 @@
 #include "scanner/util/memory.h"
 #include "scanner/util/cuda.h"
 
+#include <algorithm>
 #include <cassert>
+#include <map>
 #include <mutex>
+#include <set>
+#include <unordered_map>
 #include <sys/syscall.h>
 #include <sys/sysinfo.h>
 #include <unistd.h>
@@ -69,6 +73,8 @@ public:
   virtual ~Allocator(){};
 
   virtual u8 *allocate(size_t size) = 0;
+  // Returns nullptr instead of failing when the memory is exhausted
+  virtual u8 *try_allocate(size_t size) = 0;
   virtual void free(u8 *buffer) = 0;
 };
 
@@ -93,6 +99,24 @@ public:
     }
   }
 
+  u8 *try_allocate(size_t size) {
+    if (device_.type == DeviceType::CPU) {
+      return new (std::nothrow) u8[size];
+    } else if (device_.type == DeviceType::GPU) {
+      u8 *buffer = nullptr;
+      CUDA_PROTECT({
+        CU_CHECK(cudaSetDevice(device_.id));
+        if (cudaMalloc((void **)&buffer, size) != cudaSuccess) {
+          // Clear the error so later CUDA calls do not report it
+          cudaGetLastError();
+          buffer = nullptr;
+        }
+      })
+      return buffer;
+    }
+    return nullptr;
+  }
+
   void free(u8 *buffer) {
     if (device_.type == DeviceType::CPU) {
       delete[] buffer;
@@ -120,61 +144,150 @@ bool pointer_in_buffer(u8 *ptr, u8 *buf_start, u8 *buf_end) {
   return (size_t)ptr >= (size_t)buf_start && (size_t)ptr < (size_t)buf_end;
 }
 
+// The pool allocator serves large requests with a segregated fit over the
+// free ranges of the pool and small requests from slabs of equal sized
+// objects.
+//
+// Free ranges are binned by the log2 of their length and, within a bin,
+// ordered by length so that an allocation takes the smallest range that fits.
+// Freed ranges are coalesced with their neighbours through an address
+// ordered map of the free ranges, which keeps interleaved frame buffers and
+// small rows from fragmenting the pool.
+//
+// Small objects are carved out of SLAB_SIZE aligned slabs, each holding
+// objects of a single power of two size class. Every thread keeps a cache of
+// free objects per size class so that most small allocations and frees do
+// not take the pool lock. The size class of a pointer is found through a
+// table indexed by slab, which is read without locking. Free objects on the
+// central lists are grouped by slab, and a slab whose objects have all been
+// returned goes back to the pool, apart from a single spare slab.
 class PoolAllocator : public Allocator {
 public:
   PoolAllocator(DeviceHandle device, SystemAllocator *allocator,
                 size_t pool_size)
-      : device_(device), system_allocator(allocator), pool_size_(pool_size) {
+      : device_(device), system_allocator(allocator), pool_size_(pool_size),
+        id_(next_pool_id_++), bins_(NUM_BINS) {
     pool_ = system_allocator->allocate(pool_size_);
+    size_t num_slabs = pool_size_ / SLAB_SIZE + 1;
+    slab_classes_.reset(new std::atomic<u8>[num_slabs]);
+    for (size_t i = 0; i < num_slabs; ++i) {
+      slab_classes_[i].store(0, std::memory_order_relaxed);
+    }
+    min_class_ = 0;
+    while (class_size(min_class_) < system_allocator->alignment()) {
+      min_class_++;
+    }
+    central_slabs_.resize(NUM_CLASSES);
+    insert_free_range(0,
+                      pool_size_ - pool_size_ % system_allocator->alignment());
+
+    std::lock_guard<std::mutex> guard(registry_lock_);
+    live_pools_[id_] = this;
   }
 
-  ~PoolAllocator() { system_allocator->free(pool_); }
+  ~PoolAllocator() {
+    {
+      std::lock_guard<std::mutex> guard(registry_lock_);
+      live_pools_.erase(id_);
+    }
+    system_allocator->free(pool_);
+  }
 
   u8 *allocate(size_t size) {
-    Allocation alloc;
-    alloc.length = size;
+    u8 *buffer = try_allocate(size);
+    if (buffer == nullptr) {
+      std::lock_guard<std::mutex> guard(lock_);
+      LOG(FATAL) << "Exceeded pool size: could not allocate " << size
+                 << " bytes with " << (pool_size_ - stats_.allocated_bytes)
+                 << " bytes free";
+    }
+    return buffer;
+  }
 
+  u8 *try_allocate(size_t size) {
+    if (size <= SMALL_OBJECT_MAX_SIZE) {
+      return allocate_small(size_class(size));
+    }
+    size = align(size, system_allocator->alignment());
     std::lock_guard<std::mutex> guard(lock_);
-    bool found = false;
-    i32 num_alloc = allocations_.size();
-    for (i32 i = 0; i < num_alloc; ++i) {
-      Allocation lower;
-      if (i == 0) {
-        lower.offset = 0;
-        lower.length = 0;
-      } else {
-        lower = allocations_[i - 1];
-      }
-      Allocation higher = allocations_[i];
-      assert(higher.offset >= lower.offset + lower.length);
-      size_t base = align(lower.offset + lower.length);
-      if ((higher.offset - base) >= size) {
-        alloc.offset = base;
-        allocations_.insert(allocations_.begin() + i, alloc);
-        found = true;
+    size_t offset;
+    if (!allocate_range(size, system_allocator->alignment(), offset)) {
+      return nullptr;
+    }
+    allocated_ranges_[offset] = size;
+    return pool_ + offset;
+  }
+
+  void free(u8 *buffer) {
+    LOG_IF(FATAL, !pointer_in_buffer(buffer, pool_, pool_ + pool_size_))
+        << "Pool allocator tried to free buffer not in pool";
+
+    size_t offset = buffer - pool_;
+    u8 cls = slab_classes_[offset / SLAB_SIZE].load(std::memory_order_acquire);
+    if (cls != 0) {
+      free_small(cls - 1, buffer);
+      return;
+    }
+
+    std::lock_guard<std::mutex> guard(lock_);
+    auto it = allocated_ranges_.find(offset);
+    LOG_IF(FATAL, it == allocated_ranges_.end())
+        << "Attempted to free unallocated buffer in pool";
+    size_t length = it->second;
+    allocated_ranges_.erase(it);
+    free_range(offset, length);
+  }
+
+  MemoryPoolStats stats() {
+    std::lock_guard<std::mutex> guard(lock_);
+    MemoryPoolStats stats = stats_;
+    stats.pool_size = pool_size_;
+    stats.free_bytes = pool_size_ - stats.allocated_bytes;
+    stats.largest_free_block = 0;
+    for (i32 b = NUM_BINS - 1; b >= 0; --b) {
+      if (!bins_[b].empty()) {
+        stats.largest_free_block = bins_[b].rbegin()->first;
         break;
       }
     }
+    if (stats.free_bytes > 0) {
+      stats.fragmentation =
+          1.0 - (double)stats.largest_free_block / stats.free_bytes;
+    }
+    return stats;
+  }
 
-    if (!found) {
-      if (num_alloc > 0) {
-        Allocation &last = allocations_[num_alloc - 1];
-        alloc.offset = align(last.offset + last.length);
-      } else {
-        alloc.offset = 0;
+private:
+  static const i32 NUM_BINS = 64;
+  static const i32 NUM_CLASSES = 16;
+  static const size_t SMALL_OBJECT_MAX_SIZE = 16 * 1024;
+  static const size_t SLAB_SIZE = 256 * 1024;
+  // Objects moved between a thread cache and the central lists at a time
+  static const size_t TRANSFER_BYTES = 64 * 1024;
+
+  using ThreadCache = std::vector<std::vector<u8 *>>;
+
+  // Returns unused objects cached by a thread to their pool on thread exit
+  struct ThreadCaches {
+    ~ThreadCaches() {
+      std::lock_guard<std::mutex> guard(registry_lock_);
+      for (auto &kv : caches) {
+        auto it = live_pools_.find(kv.first);
+        if (it == live_pools_.end()) {
+          continue;
+        }
+        for (size_t c = 0; c < kv.second.size(); ++c) {
+          it->second->return_objects(c, kv.second[c], kv.second[c].size());
+        }
       }
-      allocations_.push_back(alloc);
     }
 
-    LOG_IF(FATAL, alloc.offset + alloc.length >= pool_size_)
-        << "Exceeded pool size";
+    std::map<u64, ThreadCache> caches;
+  };
 
-    u8 *buffer = pool_ + alloc.offset;
-    return buffer;
-  }
+  static size_t class_size(i32 cls) { return (size_t)64 << cls; }
 
-  size_t align(size_t ptr) {
-    size_t alignment = system_allocator->alignment();
+  static size_t align(size_t ptr, size_t alignment) {
     size_t remainder = ptr % alignment;
     if (remainder != 0) {
       return ptr + (alignment - remainder);
@@ -183,96 +296,321 @@ public:
     }
   }
 
-  void free(u8 *buffer) {
-    LOG_IF(FATAL, !pointer_in_buffer(buffer, pool_, pool_ + pool_size_))
-        << "Pool allocator tried to free buffer not in pool";
+  static i32 bin_for(size_t length) {
+    i32 bin = 0;
+    while (length > 1) {
+      length >>= 1;
+      bin++;
+    }
+    return bin;
+  }
+
+  i32 size_class(size_t size) {
+    i32 cls = min_class_;
+    while (class_size(cls) < size) {
+      cls++;
+    }
+    return cls;
+  }
+
+  size_t transfer_count(i32 cls) {
+    return std::max((size_t)1, TRANSFER_BYTES / class_size(cls));
+  }
+
+  ThreadCache &thread_cache() {
+    static thread_local ThreadCaches thread_caches;
+    ThreadCache &cache = thread_caches.caches[id_];
+    if (cache.empty()) {
+      cache.resize(NUM_CLASSES);
+    }
+    return cache;
+  }
+
+  u8 *allocate_small(i32 cls) {
+    std::vector<u8 *> &objects = thread_cache()[cls];
+    if (objects.empty()) {
+      std::lock_guard<std::mutex> guard(lock_);
+      CentralList &central = central_slabs_[cls];
+      if (central.empty() && !new_slab(cls)) {
+        return nullptr;
+      }
+      // Lower slabs are filled first so that higher ones can empty out
+      size_t n = transfer_count(cls);
+      while (n > 0 && !central.empty()) {
+        auto it = central.begin();
+        if (it->first == spare_slab_) {
+          spare_slab_ = NO_SLAB;
+        }
+        std::vector<u8 *> &slab_objects = it->second;
+        size_t count = std::min(n, slab_objects.size());
+        objects.insert(objects.end(), slab_objects.end() - count,
+                       slab_objects.end());
+        slab_objects.resize(slab_objects.size() - count);
+        n -= count;
+        if (slab_objects.empty()) {
+          central.erase(it);
+        }
+      }
+    }
+    u8 *buffer = objects.back();
+    objects.pop_back();
+    return buffer;
+  }
+
+  void free_small(i32 cls, u8 *buffer) {
+    std::vector<u8 *> &objects = thread_cache()[cls];
+    objects.push_back(buffer);
+    if (objects.size() >= 2 * transfer_count(cls)) {
+      return_objects(cls, objects, transfer_count(cls));
+    }
+  }
 
+  // Moves the last n objects of a thread cache back to the central list
+  void return_objects(i32 cls, std::vector<u8 *> &objects, size_t n) {
     std::lock_guard<std::mutex> guard(lock_);
-    i32 index;
-    bool found = find_buffer(buffer, index);
-    LOG_IF(FATAL, !found) << "Attempted to free unallocated buffer in pool";
+    CentralList &central = central_slabs_[cls];
+    size_t objects_per_slab = SLAB_SIZE / class_size(cls);
+    for (auto it = objects.end() - n; it != objects.end(); ++it) {
+      size_t slab = (*it - pool_) / SLAB_SIZE;
+      std::vector<u8 *> &slab_objects = central[slab];
+      slab_objects.push_back(*it);
+      if (slab_objects.size() < objects_per_slab) {
+        continue;
+      }
+      // Every object of the slab is free again
+      if (spare_slab_ == NO_SLAB) {
+        spare_slab_ = slab;
+      } else {
+        central.erase(slab);
+        free_slab(slab);
+      }
+    }
+    objects.resize(objects.size() - n);
+  }
+
+  // Must be called with lock_ held. Returns false if the pool is exhausted.
+  bool new_slab(i32 cls) {
+    size_t offset;
+    if (!allocate_range(SLAB_SIZE, SLAB_SIZE, offset)) {
+      return false;
+    }
+    slab_classes_[offset / SLAB_SIZE].store(cls + 1,
+                                            std::memory_order_release);
+    size_t size = class_size(cls);
+    std::vector<u8 *> &slab_objects = central_slabs_[cls][offset / SLAB_SIZE];
+    for (size_t o = SLAB_SIZE; o >= size; o -= size) {
+      slab_objects.push_back(pool_ + offset + o - size);
+    }
+    stats_.num_slabs++;
+    return true;
+  }
 
-    Allocation &alloc = allocations_[index];
-    allocations_.erase(allocations_.begin() + index);
+  // Returns a slab without live objects to the free ranges. Must be called
+  // with lock_ held.
+  void free_slab(size_t slab) {
+    slab_classes_[slab].store(0, std::memory_order_release);
+    free_range(slab * SLAB_SIZE, SLAB_SIZE);
+    stats_.num_slabs--;
   }
 
-private:
-  bool find_buffer(u8 *buffer, i32 &index) {
-    i32 num_alloc = allocations_.size();
-    for (i32 i = 0; i < num_alloc; ++i) {
-      Allocation alloc = allocations_[i];
-      if ((size_t)buffer == (size_t)pool_ + alloc.offset) {
-        index = i;
+  // Must be called with lock_ held. Returns false if no free range fits.
+  bool allocate_range(size_t size, size_t alignment, size_t &start) {
+    // Ranges in a bin are at least 2^bin long so a range in any higher bin
+    // fits a request without alignment padding
+    for (i32 b = bin_for(size); b < NUM_BINS; ++b) {
+      auto &bin = bins_[b];
+      for (auto it = bin.lower_bound(std::make_pair(size, (size_t)0));
+           it != bin.end(); ++it) {
+        size_t length = it->first;
+        size_t offset = it->second;
+        start = align(offset, alignment);
+        if (start + size > offset + length) {
+          continue;
+        }
+        erase_free_range(offset, length);
+        if (start > offset) {
+          insert_free_range(offset, start - offset);
+        }
+        if (start + size < offset + length) {
+          insert_free_range(start + size, offset + length - start - size);
+        }
+        stats_.allocated_bytes += size;
+        stats_.peak_allocated_bytes =
+            std::max(stats_.peak_allocated_bytes, stats_.allocated_bytes);
         return true;
       }
     }
     return false;
   }
 
-  typedef struct {
-    size_t offset;
-    size_t length;
-  } Allocation;
+  // Must be called with lock_ held
+  void free_range(size_t offset, size_t length) {
+    stats_.allocated_bytes -= length;
+    // Coalesce with the free ranges directly after and before this one
+    auto next = free_ranges_.find(offset + length);
+    if (next != free_ranges_.end()) {
+      size_t next_length = next->second;
+      erase_free_range(offset + length, next_length);
+      length += next_length;
+    }
+    auto prev = free_ranges_.lower_bound(offset);
+    if (prev != free_ranges_.begin()) {
+      --prev;
+      if (prev->first + prev->second == offset) {
+        size_t prev_offset = prev->first;
+        size_t prev_length = prev->second;
+        erase_free_range(prev_offset, prev_length);
+        offset = prev_offset;
+        length += prev_length;
+      }
+    }
+    insert_free_range(offset, length);
+  }
+
+  void insert_free_range(size_t offset, size_t length) {
+    free_ranges_[offset] = length;
+    bins_[bin_for(length)].insert(std::make_pair(length, offset));
+  }
+
+  void erase_free_range(size_t offset, size_t length) {
+    free_ranges_.erase(offset);
+    bins_[bin_for(length)].erase(std::make_pair(length, offset));
+  }
+
+  static std::atomic<u64> next_pool_id_;
+  static std::mutex registry_lock_;
+  static std::map<u64, PoolAllocator *> live_pools_;
 
   DeviceHandle device_;
   u8 *pool_ = nullptr;
   size_t pool_size_;
+  u64 id_;
+  i32 min_class_;
   std::mutex lock_;
-  std::vector<Allocation> allocations_;
+  // Free ranges keyed by offset and binned by (length, offset)
+  std::map<size_t, size_t> free_ranges_;
+  std::vector<std::set<std::pair<size_t, size_t>>> bins_;
+  // Lengths of large allocations keyed by offset
+  std::unordered_map<size_t, size_t> allocated_ranges_;
+  // Size class + 1 of every slab, or 0 if the slab is not small object memory
+  std::unique_ptr<std::atomic<u8>[]> slab_classes_;
+  // Free objects of each size class, grouped by slab index
+  using CentralList = std::map<size_t, std::vector<u8 *>>;
+  std::vector<CentralList> central_slabs_;
+  // Slab kept for reuse once all of its objects were freed
+  static const size_t NO_SLAB = (size_t)-1;
+  size_t spare_slab_ = NO_SLAB;
+  MemoryPoolStats stats_;
 
   SystemAllocator *system_allocator;
 };
 
+std::atomic<u64> PoolAllocator::next_pool_id_{0};
+std::mutex PoolAllocator::registry_lock_;
+std::map<u64, PoolAllocator *> PoolAllocator::live_pools_;
+
+// Blocks are mostly batches of frames or kernel outputs which are allocated
+// over and over with the same size, so the block allocator keeps blocks of at
+// least MIN_RECYCLED_BLOCK_SIZE bytes around after their last row is freed
+// and hands them out again for requests of exactly the same size. At most
+// max_recycled_bytes are retained. When a freed block does not fit, blocks of
+// other sizes are released first since they are likely from a previous
+// frame geometry.
 class BlockAllocator {
 public:
-  BlockAllocator(Allocator *allocator) : allocator_(allocator) {}
+  BlockAllocator(Allocator *allocator, size_t max_recycled_bytes)
+      : allocator_(allocator), max_recycled_bytes_(max_recycled_bytes) {}
 
-  u8 *allocate(size_t size, i32 refs) {
-    u8 *buffer = allocator_->allocate(size);
+  ~BlockAllocator() {
+    for (auto &kv : recycled_) {
+      for (u8 *buffer : kv.second) {
+        allocator_->free(buffer);
+      }
+    }
+  }
 
+  u8 *allocate(size_t size, i32 refs) {
     Allocation alloc;
-    alloc.buffer = buffer;
     alloc.size = size;
     alloc.refs = refs;
 
+    {
+      std::lock_guard<std::mutex> guard(lock_);
+      auto it = recycled_.find(size);
+      if (it != recycled_.end() && !it->second.empty()) {
+        u8 *buffer = it->second.back();
+        it->second.pop_back();
+        recycled_bytes_ -= size;
+        allocations_[buffer] = alloc;
+        return buffer;
+      }
+    }
+
+    u8 *buffer = allocator_->try_allocate(size);
+    if (buffer == nullptr) {
+      // Recycled blocks may be what is holding the memory
+      release_recycled();
+      buffer = allocator_->allocate(size);
+    }
+
     std::lock_guard<std::mutex> guard(lock_);
-    allocations_.push_back(alloc);
+    allocations_[buffer] = alloc;
 
     return buffer;
   }
 
+  // Frees all blocks kept for reuse
+  void release_recycled() {
+    std::lock_guard<std::mutex> guard(lock_);
+    for (auto &kv : recycled_) {
+      for (u8 *buffer : kv.second) {
+        allocator_->free(buffer);
+      }
+    }
+    recycled_.clear();
+    recycled_bytes_ = 0;
+  }
+
   void free(u8 *buffer) {
+    LOG_IF(FATAL, !try_free(buffer))
+        << "Block allocator freed non-block buffer";
+  }
+
+  // Drops a reference to the block containing buffer. Returns false if the
+  // buffer is not part of any block.
+  bool try_free(u8 *buffer) {
     std::lock_guard<std::mutex> guard(lock_);
 
-    i32 index;
-    bool found = find_buffer(buffer, index);
-    LOG_IF(FATAL, !found) << "Block allocator freed non-block buffer";
+    AllocationMap::iterator it;
+    if (!find_buffer(buffer, it)) {
+      return false;
+    }
 
-    Allocation &alloc = allocations_[index];
+    Allocation &alloc = it->second;
     assert(alloc.refs > 0);
     alloc.refs -= 1;
 
     if (alloc.refs == 0) {
-      allocator_->free(alloc.buffer);
-      allocations_.erase(allocations_.begin() + index);
-      return;
+      recycle(it->first, alloc.size);
+      allocations_.erase(it);
     }
+    return true;
   }
 
   bool buffers_in_same_block(std::vector<u8 *> buffers) {
     assert(buffers.size() > 0);
 
     std::lock_guard<std::mutex> guard(lock_);
-    i32 base_index;
-    bool found = find_buffer(buffers[0], base_index);
+    AllocationMap::iterator base_it;
+    bool found = find_buffer(buffers[0], base_it);
     if (!found) {
       return false;
     }
 
     for (i32 i = 1; i < buffers.size(); ++i) {
-      i32 index;
-      found = find_buffer(buffers[i], index);
-      if (!found || base_index != index) {
+      AllocationMap::iterator it;
+      found = find_buffer(buffers[i], it);
+      if (!found || base_it != it) {
         return false;
       }
     }
@@ -282,36 +620,93 @@ public:
 
   bool buffer_in_block(u8 *buffer) {
     std::lock_guard<std::mutex> guard(lock_);
-    i32 index;
-    return find_buffer(buffer, index);
+    AllocationMap::iterator it;
+    return find_buffer(buffer, it);
   }
 
-private:
-  bool find_buffer(u8 *buffer, i32 &index) {
-    i32 num_alloc = allocations_.size();
-    for (i32 i = 0; i < num_alloc; ++i) {
-      Allocation alloc = allocations_[i];
-      if (pointer_in_buffer(buffer, alloc.buffer, alloc.buffer + alloc.size)) {
-        index = i;
-        return true;
-      }
+  BlockStats stats() {
+    std::lock_guard<std::mutex> guard(lock_);
+    BlockStats stats;
+    stats.live_blocks = allocations_.size();
+    for (auto &kv : allocations_) {
+      stats.live_bytes += kv.second.size;
     }
-    return false;
+    stats.recycled_bytes = recycled_bytes_;
+    return stats;
   }
 
+private:
   typedef struct {
-    u8 *buffer;
     size_t size;
     i32 refs;
   } Allocation;
 
+  // Blocks never overlap, so ordering them by base address lets us find the
+  // block containing a pointer by looking at its closest predecessor
+  typedef std::map<u8 *, Allocation> AllocationMap;
+
+  // Must be called with lock_ held
+  void recycle(u8 *buffer, size_t size) {
+    if (size < MIN_RECYCLED_BLOCK_SIZE || size > max_recycled_bytes_) {
+      allocator_->free(buffer);
+      return;
+    }
+    for (auto it = recycled_.begin();
+         it != recycled_.end() &&
+         recycled_bytes_ + size > max_recycled_bytes_;) {
+      if (it->first != size) {
+        for (u8 *old_buffer : it->second) {
+          allocator_->free(old_buffer);
+          recycled_bytes_ -= it->first;
+        }
+        it = recycled_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    if (recycled_bytes_ + size > max_recycled_bytes_) {
+      allocator_->free(buffer);
+      return;
+    }
+    recycled_[size].push_back(buffer);
+    recycled_bytes_ += size;
+  }
+
+  bool find_buffer(u8 *buffer, AllocationMap::iterator &it) {
+    it = allocations_.upper_bound(buffer);
+    if (it == allocations_.begin()) {
+      return false;
+    }
+    --it;
+    return pointer_in_buffer(buffer, it->first, it->first + it->second.size);
+  }
+
+  static const size_t MIN_RECYCLED_BLOCK_SIZE = 64 * 1024;
+
   std::mutex lock_;
-  std::vector<Allocation> allocations_;
+  AllocationMap allocations_;
   Allocator *allocator_;
+  // Freed blocks available for reuse, keyed by size
+  std::unordered_map<size_t, std::vector<u8 *>> recycled_;
+  size_t recycled_bytes_ = 0;
+  size_t max_recycled_bytes_;
 };
 
+size_t max_recycled_bytes(const MemoryPoolConfig::Pool &config,
+                          size_t default_bytes) {
+  if (config.max_recycled_bytes() < 0) {
+    return 0;
+  } else if (config.max_recycled_bytes() == 0) {
+    return default_bytes;
+  } else {
+    return config.max_recycled_bytes();
+  }
+}
+
 static SystemAllocator *cpu_system_allocator = nullptr;
 static std::map<i32, SystemAllocator *> gpu_system_allocators;
+static PoolAllocator *cpu_pool_allocator = nullptr;
+static std::map<i32, PoolAllocator *> gpu_pool_allocators;
 static BlockAllocator *cpu_block_allocator = nullptr;
 static std::map<i32, BlockAllocator *> gpu_block_allocators;
 
@@ -327,11 +722,14 @@ void init_memory_allocators(MemoryPoolConfig config,
     LOG_IF(FATAL, config.cpu().free_space() > total_mem)
         << "Requested CPU free space (" << config.cpu().free_space() << ") "
         << "larger than total CPU memory size ( " << total_mem << ")";
-    cpu_block_allocator_base =
+    cpu_pool_allocator =
         new PoolAllocator(CPU_DEVICE, cpu_system_allocator,
                           total_mem - config.cpu().free_space());
+    cpu_block_allocator_base = cpu_pool_allocator;
   }
-  cpu_block_allocator = new BlockAllocator(cpu_block_allocator_base);
+  cpu_block_allocator = new BlockAllocator(
+      cpu_block_allocator_base,
+      max_recycled_bytes(config.cpu(), DEFAULT_MAX_RECYCLED_BYTES));
 
 #ifdef HAVE_CUDA
   for (i32 device_id : gpu_device_ids) {
@@ -347,27 +745,73 @@ void init_memory_allocators(MemoryPoolConfig config,
           << "Requested GPU free space (" << config.gpu().free_space() << ") "
           << "larger than total GPU memory size ( " << total_mem << ") "
           << "on device " << device_id;
-      gpu_block_allocator_base = new PoolAllocator(
+      PoolAllocator *gpu_pool_allocator = new PoolAllocator(
           device, gpu_system_allocator, total_mem - config.gpu().free_space());
+      gpu_pool_allocators[device.id] = gpu_pool_allocator;
+      gpu_block_allocator_base = gpu_pool_allocator;
     }
-    gpu_block_allocators[device.id] =
-        new BlockAllocator(gpu_block_allocator_base);
+    gpu_block_allocators[device.id] = new BlockAllocator(
+        gpu_block_allocator_base,
+        max_recycled_bytes(config.gpu(), DEFAULT_MAX_GPU_RECYCLED_BYTES));
   }
 #endif
 }
 
 void destroy_memory_allocators() {
-  delete cpu_system_allocator;
+  // Pools must go before the system allocators they were allocated from
   delete cpu_block_allocator;
+  delete cpu_pool_allocator;
+  delete cpu_system_allocator;
+  cpu_block_allocator = nullptr;
+  cpu_pool_allocator = nullptr;
+  cpu_system_allocator = nullptr;
 
 #ifdef HAVE_CUDA
-  for (auto entry : gpu_system_allocators) {
+  for (auto entry : gpu_block_allocators) {
     delete entry.second;
   }
-  for (auto entry : gpu_block_allocators) {
+  for (auto entry : gpu_pool_allocators) {
+    delete entry.second;
+  }
+  for (auto entry : gpu_system_allocators) {
     delete entry.second;
   }
 #endif
+  gpu_block_allocators.clear();
+  gpu_pool_allocators.clear();
+  gpu_system_allocators.clear();
+}
+
+MemoryPoolStats memory_pool_stats(DeviceHandle device) {
+  PoolAllocator *pool = nullptr;
+  if (device.type == DeviceType::CPU) {
+    pool = cpu_pool_allocator;
+  } else if (device.type == DeviceType::GPU) {
+    auto it = gpu_pool_allocators.find(device.id);
+    if (it != gpu_pool_allocators.end()) {
+      pool = it->second;
+    }
+  }
+  if (pool == nullptr) {
+    return MemoryPoolStats();
+  }
+  return pool->stats();
+}
+
+BlockStats block_stats(DeviceHandle device) {
+  BlockAllocator *allocator = nullptr;
+  if (device.type == DeviceType::CPU) {
+    allocator = cpu_block_allocator;
+  } else if (device.type == DeviceType::GPU) {
+    auto it = gpu_block_allocators.find(device.id);
+    if (it != gpu_block_allocators.end()) {
+      allocator = it->second;
+    }
+  }
+  if (allocator == nullptr) {
+    return BlockStats();
+  }
+  return allocator->stats();
 }
 
 SystemAllocator *system_allocator_for_device(DeviceHandle device) {
@@ -407,9 +851,7 @@ u8 *new_block_buffer(DeviceHandle device, size_t size, i32 refs) {
 void delete_buffer(DeviceHandle device, u8 *buffer) {
   assert(buffer != nullptr);
   BlockAllocator *block_allocator = block_allocator_for_device(device);
-  if (block_allocator->buffer_in_block(buffer)) {
-    block_allocator->free(buffer);
-  } else {
+  if (!block_allocator->try_free(buffer)) {
     SystemAllocator *system_allocator = system_allocator_for_device(device);
     system_allocator->free(buffer);
   }
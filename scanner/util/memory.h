@@ -22,11 +22,40 @@
 namespace scanner {
 
 static const i64 DEFAULT_POOL_SIZE = 2L*1024L*1024L*1024L;
+static const i64 DEFAULT_MAX_RECYCLED_BYTES = 1L*1024L*1024L*1024L;
+// Device memory is scarcer, so less of it is held back for reuse
+static const i64 DEFAULT_MAX_GPU_RECYCLED_BYTES = 256L*1024L*1024L;
 
 void init_memory_allocators(MemoryPoolConfig config, std::vector<i32> gpu_device_ids);
 
 void destroy_memory_allocators();
 
+struct MemoryPoolStats {
+  // Size of the pool, 0 if the device does not use a memory pool
+  size_t pool_size = 0;
+  // Bytes currently reserved from the pool, including small object slabs
+  size_t allocated_bytes = 0;
+  // Most bytes reserved from the pool at any one time
+  size_t peak_allocated_bytes = 0;
+  size_t free_bytes = 0;
+  size_t largest_free_block = 0;
+  // Fraction of free bytes outside of the largest free block
+  double fragmentation = 0;
+  i64 num_slabs = 0;
+};
+
+MemoryPoolStats memory_pool_stats(DeviceHandle device);
+
+struct BlockStats {
+  // Blocks with rows that have not been freed yet
+  i64 live_blocks = 0;
+  size_t live_bytes = 0;
+  // Freed blocks kept for reuse
+  size_t recycled_bytes = 0;
+};
+
+BlockStats block_stats(DeviceHandle device);
+
 u8* new_buffer(DeviceHandle device, size_t size);
 
 u8* new_block_buffer(DeviceHandle device, size_t size, i32 refs);
@@ -0,0 +1,229 @@
+/* Copyright 2016 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/util/memory.h"
+#include "scanner/util/util.h"
+
+#include <gtest/gtest.h>
+
+#include <sys/sysinfo.h>
+#include <thread>
+
+namespace scanner {
+namespace {
+// Allocates num_blocks blocks of rows_per_block rows and then frees every
+// row, interleaving blocks so that each free has to locate a different block.
+// Returns the average time in nanoseconds spent per delete_buffer call.
+double time_block_frees(i32 num_blocks, i32 rows_per_block) {
+  const size_t row_size = 64;
+  std::vector<u8 *> blocks;
+  for (i32 b = 0; b < num_blocks; ++b) {
+    blocks.push_back(new_block_buffer(CPU_DEVICE, row_size * rows_per_block,
+                                      rows_per_block));
+  }
+  // Interleave single allocations so the lookup also sees non-block buffers
+  std::vector<u8 *> singles;
+  for (i32 b = 0; b < num_blocks; ++b) {
+    singles.push_back(new_buffer(CPU_DEVICE, row_size));
+  }
+
+  auto start = now();
+  for (i32 r = 0; r < rows_per_block; ++r) {
+    for (i32 b = 0; b < num_blocks; ++b) {
+      delete_buffer(CPU_DEVICE, blocks[b] + row_size * r);
+    }
+  }
+  for (u8 *buffer : singles) {
+    delete_buffer(CPU_DEVICE, buffer);
+  }
+  double elapsed = nano_since(start);
+  return elapsed / (num_blocks * (rows_per_block + 1));
+}
+
+MemoryPoolConfig cpu_pool_config(size_t pool_size) {
+  struct sysinfo info;
+  sysinfo(&info);
+  MemoryPoolConfig config;
+  config.mutable_cpu()->set_use_pool(true);
+  config.mutable_cpu()->set_free_space(info.totalram - pool_size);
+  // Test the pool itself without freed blocks being held back for reuse
+  config.mutable_cpu()->set_max_recycled_bytes(-1);
+  return config;
+}
+}
+
+TEST(BlockAllocator, FreesEveryRow) {
+  init_memory_allocators(MemoryPoolConfig(), {});
+  // Freeing a block row by row must release the block exactly once, on the
+  // last row
+  for (i32 i = 0; i < 4; ++i) {
+    u8 *block = new_block_buffer(CPU_DEVICE, 1024, 8);
+    BlockStats stats = block_stats(CPU_DEVICE);
+    EXPECT_EQ(stats.live_blocks, 1);
+    EXPECT_EQ(stats.live_bytes, 1024);
+    for (i32 r = 0; r < 8; ++r) {
+      EXPECT_EQ(block_stats(CPU_DEVICE).live_blocks, 1);
+      delete_buffer(CPU_DEVICE, block + 128 * r);
+    }
+    stats = block_stats(CPU_DEVICE);
+    EXPECT_EQ(stats.live_blocks, 0);
+    EXPECT_EQ(stats.live_bytes, 0);
+  }
+  // Single buffers are not blocks
+  u8 *single = new_buffer(CPU_DEVICE, 16);
+  EXPECT_EQ(block_stats(CPU_DEVICE).live_blocks, 0);
+  delete_buffer(CPU_DEVICE, single);
+  destroy_memory_allocators();
+}
+
+// Not part of the regular run, use --gtest_also_run_disabled_tests
+TEST(BlockAllocator, DISABLED_FreeBenchmark) {
+  init_memory_allocators(MemoryPoolConfig(), {});
+  const i32 rows_per_block = 64;
+  for (i32 num_blocks : {16, 256, 4096}) {
+    double ns = time_block_frees(num_blocks, rows_per_block);
+    std::cout << num_blocks << " live blocks: " << ns << " ns per free"
+              << std::endl;
+    EXPECT_EQ(block_stats(CPU_DEVICE).live_blocks, 0);
+  }
+  destroy_memory_allocators();
+}
+
+TEST(PoolAllocator, CoalescesFreedBlocks) {
+  const size_t pool_size = 64 * 1024 * 1024;
+  init_memory_allocators(cpu_pool_config(pool_size), {});
+
+  // Interleave large frame sized blocks with small rows
+  std::vector<u8 *> frames;
+  std::vector<u8 *> rows;
+  for (i32 i = 0; i < 16; ++i) {
+    frames.push_back(new_block_buffer(CPU_DEVICE, 1920 * 1080 * 3 / 4, 1));
+    rows.push_back(new_block_buffer(CPU_DEVICE, 32, 1));
+  }
+  MemoryPoolStats stats = memory_pool_stats(CPU_DEVICE);
+  EXPECT_EQ(stats.pool_size, pool_size);
+  EXPECT_GE(stats.allocated_bytes, 16 * 1920 * 1080 * 3 / 4);
+  EXPECT_EQ(stats.peak_allocated_bytes, stats.allocated_bytes);
+
+  for (u8 *frame : frames) {
+    delete_buffer(CPU_DEVICE, frame);
+  }
+  // With the frames gone only the slab for the small rows stays reserved and
+  // the rest of the pool must be one contiguous free block again
+  stats = memory_pool_stats(CPU_DEVICE);
+  EXPECT_EQ(stats.num_slabs, 1);
+  EXPECT_GE(stats.largest_free_block, pool_size / 2);
+  EXPECT_LT(stats.fragmentation, 0.5);
+
+  u8 *big = new_block_buffer(CPU_DEVICE, pool_size / 2, 1);
+  delete_buffer(CPU_DEVICE, big);
+  for (u8 *row : rows) {
+    delete_buffer(CPU_DEVICE, row);
+  }
+  destroy_memory_allocators();
+}
+
+TEST(PoolAllocator, ReturnsEmptySlabs) {
+  init_memory_allocators(cpu_pool_config(64 * 1024 * 1024), {});
+  // A spike of small rows spreads over many slabs. Once the thread that freed
+  // them exits and hands its cache back, only one spare slab stays reserved.
+  std::thread spike([]() {
+    std::vector<u8 *> rows;
+    for (i32 i = 0; i < 4096; ++i) {
+      rows.push_back(new_block_buffer(CPU_DEVICE, 1024, 1));
+    }
+    EXPECT_GE(memory_pool_stats(CPU_DEVICE).num_slabs, 16);
+    for (u8 *row : rows) {
+      delete_buffer(CPU_DEVICE, row);
+    }
+  });
+  spike.join();
+  MemoryPoolStats stats = memory_pool_stats(CPU_DEVICE);
+  EXPECT_EQ(stats.num_slabs, 1);
+  EXPECT_EQ(stats.allocated_bytes, 256 * 1024);
+  destroy_memory_allocators();
+}
+
+TEST(PoolAllocator, SmallObjectsAcrossThreads) {
+  init_memory_allocators(cpu_pool_config(64 * 1024 * 1024), {});
+  // Buffers allocated on one thread and freed on another end up in the
+  // freeing thread's cache and must be reusable from there
+  const i32 num_buffers = 10000;
+  std::vector<u8 *> buffers(num_buffers);
+  std::thread producer([&]() {
+    for (i32 i = 0; i < num_buffers; ++i) {
+      buffers[i] = new_block_buffer(CPU_DEVICE, 16 + i % 4000, 1);
+      memset(buffers[i], i % 256, 16);
+    }
+  });
+  producer.join();
+  for (i32 i = 0; i < num_buffers; ++i) {
+    EXPECT_EQ(buffers[i][15], i % 256);
+    delete_buffer(CPU_DEVICE, buffers[i]);
+  }
+  for (i32 i = 0; i < num_buffers; ++i) {
+    buffers[i] = new_block_buffer(CPU_DEVICE, 16 + i % 4000, 1);
+  }
+  for (u8 *buffer : buffers) {
+    delete_buffer(CPU_DEVICE, buffer);
+  }
+  destroy_memory_allocators();
+}
+
+TEST(BlockAllocator, RecyclesFreedBlocks) {
+  MemoryPoolConfig config;
+  config.mutable_cpu()->set_max_recycled_bytes(8 * 1024 * 1024);
+  init_memory_allocators(config, {});
+
+  const size_t frame_size = 640 * 480 * 3;
+  u8 *block = new_block_buffer(CPU_DEVICE, frame_size * 2, 2);
+  delete_buffer(CPU_DEVICE, block);
+  delete_buffer(CPU_DEVICE, block + frame_size);
+  // A block of the same size reuses the freed one
+  u8 *same = new_block_buffer(CPU_DEVICE, frame_size * 2, 1);
+  EXPECT_EQ(same, block);
+  // Another geometry gets fresh memory and evicts the old size once the
+  // retained memory would exceed the limit
+  u8 *other = new_block_buffer(CPU_DEVICE, 4 * 1024 * 1024, 1);
+  EXPECT_NE(other, block);
+  delete_buffer(CPU_DEVICE, same);
+  delete_buffer(CPU_DEVICE, other);
+  u8 *reused = new_block_buffer(CPU_DEVICE, 4 * 1024 * 1024, 1);
+  EXPECT_EQ(reused, other);
+  delete_buffer(CPU_DEVICE, reused);
+  destroy_memory_allocators();
+}
+
+TEST(BlockAllocator, ReleasesRecycledBlocksWhenPoolIsFull) {
+  const size_t pool_size = 16 * 1024 * 1024;
+  MemoryPoolConfig config = cpu_pool_config(pool_size);
+  config.mutable_cpu()->set_max_recycled_bytes(pool_size);
+  init_memory_allocators(config, {});
+
+  // The freed block is kept for reuse and occupies most of the pool
+  const size_t block_size = 10 * 1024 * 1024;
+  u8 *block = new_block_buffer(CPU_DEVICE, block_size, 1);
+  delete_buffer(CPU_DEVICE, block);
+  EXPECT_EQ(block_stats(CPU_DEVICE).recycled_bytes, block_size);
+
+  // A block of another size only fits once the recycled one is released
+  u8 *other = new_block_buffer(CPU_DEVICE, block_size + 4096, 1);
+  BlockStats stats = block_stats(CPU_DEVICE);
+  EXPECT_EQ(stats.live_blocks, 1);
+  EXPECT_EQ(stats.recycled_bytes, 0);
+  delete_buffer(CPU_DEVICE, other);
+  destroy_memory_allocators();
+}
+}
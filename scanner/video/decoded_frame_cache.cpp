@@ -0,0 +1,93 @@
+/* Copyright 2016 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/video/decoded_frame_cache.h"
+#include "scanner/util/memory.h"
+
+namespace scanner {
+namespace internal {
+
+DecodedFrameCache::Frame::Frame(DeviceHandle device, size_t size)
+    : device(device), size(size) {
+  // Frame sized blocks are recycled by the block allocator so evicting and
+  // inserting frames does not go back to the system allocator
+  buffer = new_block_buffer(device, size, 1);
+}
+
+DecodedFrameCache::Frame::~Frame() { delete_buffer(device, buffer); }
+
+size_t DecodedFrameCache::KeyHash::operator()(const Key& key) const {
+  size_t h = std::hash<i64>()(key.frame);
+  h = h * 31 + std::hash<i32>()(key.item_id);
+  h = h * 31 + std::hash<i32>()(key.column_id);
+  h = h * 31 + std::hash<i32>()(key.table_id);
+  return h;
+}
+
+DecodedFrameCache::DecodedFrameCache(size_t capacity) : capacity_(capacity) {}
+
+std::shared_ptr<const DecodedFrameCache::Frame> DecodedFrameCache::lookup(
+    const Key& key) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    misses_++;
+    return nullptr;
+  }
+  hits_++;
+  lru_.splice(lru_.begin(), lru_, it->second);
+  return it->second->second;
+}
+
+std::shared_ptr<const DecodedFrameCache::Frame> DecodedFrameCache::insert(
+    const Key& key, const u8* buffer, DeviceHandle device, size_t size) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second);
+      return it->second->second;
+    }
+  }
+
+  // Copy outside of the lock since frames can be large
+  std::shared_ptr<Frame> frame(new Frame(device, size));
+  memcpy_buffer(frame->buffer, device, buffer, device, size);
+  if (size > capacity_) {
+    return frame;
+  }
+
+  // Evicted frames are released after the lock is dropped
+  std::vector<std::shared_ptr<const Frame>> evicted;
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto it = entries_.find(key);
+  if (it != entries_.end()) {
+    return it->second->second;
+  }
+  while (size_ + size > capacity_ && !lru_.empty()) {
+    auto& last = lru_.back();
+    size_ -= last.second->size;
+    evicted.push_back(last.second);
+    entries_.erase(last.first);
+    lru_.pop_back();
+  }
+  lru_.emplace_front(key, frame);
+  entries_[key] = lru_.begin();
+  size_ += size;
+  return frame;
+}
+
+}
+}
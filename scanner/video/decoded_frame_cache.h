@@ -0,0 +1,94 @@
+/* Copyright 2016 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "scanner/util/common.h"
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace scanner {
+namespace internal {
+
+///////////////////////////////////////////////////////////////////////////////
+/// DecodedFrameCache
+///
+/// Byte bounded LRU cache of decoded video frames shared by the pre-evaluate
+/// threads of a node. Samplers such as Stencil turn neighbouring rows into
+/// separate io items that each decode from the preceding keyframe, so frames
+/// decoded for one item are kept here for the items that follow.
+class DecodedFrameCache {
+ public:
+  struct Key {
+    i32 table_id;
+    i32 column_id;
+    i32 item_id;
+    i64 frame;
+
+    bool operator==(const Key& other) const {
+      return table_id == other.table_id && column_id == other.column_id &&
+             item_id == other.item_id && frame == other.frame;
+    }
+  };
+
+  // A frame owned by the cache. Frames stay valid while referenced even if
+  // they have been evicted in the meantime.
+  struct Frame {
+    Frame(DeviceHandle device, size_t size);
+    ~Frame();
+
+    DeviceHandle device;
+    u8* buffer;
+    size_t size;
+  };
+
+  DecodedFrameCache(size_t capacity);
+
+  size_t capacity() const { return capacity_; }
+
+  // Returns nullptr if the frame is not cached
+  std::shared_ptr<const Frame> lookup(const Key& key);
+
+  // Stores a copy of the frame in buffer, evicting the least recently used
+  // frames to stay within the capacity. Returns the cached frame.
+  std::shared_ptr<const Frame> insert(const Key& key, const u8* buffer,
+                                      DeviceHandle device, size_t size);
+
+  i64 hits() const { return hits_; }
+  i64 misses() const { return misses_; }
+
+ private:
+  struct KeyHash {
+    size_t operator()(const Key& key) const;
+  };
+
+  using LRUList = std::list<std::pair<Key, std::shared_ptr<const Frame>>>;
+
+  size_t capacity_;
+  std::mutex mutex_;
+  size_t size_ = 0;
+  // Most recently used first
+  LRUList lru_;
+  std::unordered_map<Key, LRUList::iterator, KeyHash> entries_;
+  std::atomic<i64> hits_{0};
+  std::atomic<i64> misses_{0};
+};
+
+}
+}
@@ -0,0 +1,62 @@
+/* Copyright 2016 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/video/decoded_frame_cache.h"
+#include "scanner/util/memory.h"
+
+#include <gtest/gtest.h>
+
+namespace scanner {
+namespace internal {
+
+TEST(DecodedFrameCache, EvictsLeastRecentlyUsed) {
+  init_memory_allocators(MemoryPoolConfig(), {});
+  {
+    const size_t frame_size = 1024;
+    std::vector<u8> frame(frame_size);
+    DecodedFrameCache cache(3 * frame_size);
+
+    for (i64 f = 0; f < 3; ++f) {
+      frame[0] = f;
+      cache.insert({0, 1, 0, f}, frame.data(), CPU_DEVICE, frame_size);
+    }
+    // Touch frame 0 so frame 1 becomes the least recently used
+    std::shared_ptr<const DecodedFrameCache::Frame> first =
+        cache.lookup({0, 1, 0, 0});
+    ASSERT_TRUE(first != nullptr);
+    EXPECT_EQ(first->buffer[0], 0);
+
+    frame[0] = 3;
+    cache.insert({0, 1, 0, 3}, frame.data(), CPU_DEVICE, frame_size);
+    EXPECT_TRUE(cache.lookup({0, 1, 0, 1}) == nullptr);
+    EXPECT_TRUE(cache.lookup({0, 1, 0, 2}) != nullptr);
+    EXPECT_TRUE(cache.lookup({0, 1, 0, 3}) != nullptr);
+    // Frames from another item are keyed separately
+    EXPECT_TRUE(cache.lookup({0, 1, 1, 3}) == nullptr);
+    EXPECT_EQ(cache.hits(), 3);
+    EXPECT_EQ(cache.misses(), 2);
+
+    // Frames stay valid while referenced even after being evicted
+    for (i64 f = 4; f < 7; ++f) {
+      cache.insert({0, 1, 0, f}, frame.data(), CPU_DEVICE, frame_size);
+    }
+    EXPECT_TRUE(cache.lookup({0, 1, 0, 0}) == nullptr);
+    EXPECT_EQ(first->buffer[0], 0);
+  }
+  destroy_memory_allocators();
+}
+
+}
+}
@@ -19,6 +19,8 @@
 #include "scanner/util/h264.h"
 #include "scanner/util/memory.h"
 
+#include <algorithm>
+#include <cstring>
 #include <thread>
 
 namespace scanner {
@@ -55,56 +57,248 @@ DecoderAutomata::~DecoderAutomata() {
   feeder_thread_.join();
 }
 
+u8 *new_encoded_video_row(const proto::DecodeArgs &args, size_t encoded_size,
+                          u8 *&encoded_data, size_t &row_size) {
+  u64 args_size = args.ByteSize();
+  row_size = sizeof(u64) + args_size + encoded_size;
+  u8 *row = new_buffer(CPU_DEVICE, row_size);
+  *reinterpret_cast<u64 *>(row) = args_size;
+  args.SerializeToArray(row + sizeof(u64), args_size);
+  encoded_data = row + sizeof(u64) + args_size;
+  return row;
+}
+
+EncodedVideo parse_encoded_video_row(DeviceHandle device, u8 *row,
+                                     size_t row_size) {
+  EncodedVideo video;
+  u64 args_size = *reinterpret_cast<const u64 *>(row);
+  video.args.ParseFromArray(row + sizeof(u64), args_size);
+  video.buffer = std::shared_ptr<const u8>(
+      row, [device](const u8 *buffer) {
+        delete_buffer(device, const_cast<u8 *>(buffer));
+      });
+  video.data = row + sizeof(u64) + args_size;
+  video.size = row_size - sizeof(u64) - args_size;
+  return video;
+}
+
+EncodedVideo encoded_video_from_args(proto::DecodeArgs args) {
+  EncodedVideo video;
+  const std::string &encoded = args.encoded_video();
+  u8 *buffer = new_buffer(CPU_DEVICE, encoded.size());
+  std::memcpy(buffer, encoded.data(), encoded.size());
+  video.buffer = std::shared_ptr<const u8>(buffer, [](const u8 *buffer) {
+    delete_buffer(CPU_DEVICE, const_cast<u8 *>(buffer));
+  });
+  video.data = buffer;
+  video.size = encoded.size();
+  args.clear_encoded_video();
+  video.args = std::move(args);
+  return video;
+}
+
+FrameInfo decoded_frame_info(const proto::DecodeArgs &args) {
+  FrameInfo info;
+  info.set_width(args.output_width() > 0 ? args.output_width() : args.width());
+  info.set_height(args.output_height() > 0 ? args.output_height()
+                                           : args.height());
+  info.set_format(args.format());
+  return info;
+}
+
+size_t decoded_frame_size(const proto::DecodeArgs &args) {
+  FrameInfo info = decoded_frame_info(args);
+  return frame_buffer_size(info.width(), info.height(), info.format());
+}
+
+DecoderAutomata::SkipMap DecoderAutomata::make_skip_map(
+    const proto::DecodeArgs &args) {
+  SkipMap map;
+  map.start = args.start_keyframe();
+  i64 num_frames = args.end_keyframe() - args.start_keyframe();
+  map.packets.resize(num_frames, false);
+  map.frames.resize(num_frames, false);
+  auto &valid = args.valid_frames();
+
+  // GOPs only needed for their keyframe are decoded from the keyframe alone
+  // and GOPs without requested frames are not decoded at all. Keyframes are
+  // IDR frames, so frames never cross between GOPs.
+  for (i32 k = 0; k + 1 < args.keyframes_size(); ++k) {
+    i64 keyframe = args.keyframes(k);
+    i64 next_keyframe = args.keyframes(k + 1);
+    auto first = std::lower_bound(valid.begin(), valid.end(), keyframe);
+    auto last = std::lower_bound(first, valid.end(), next_keyframe);
+    i64 first_skipped = -1;
+    if (first == last) {
+      first_skipped = keyframe;
+    } else if (last - first == 1 && *first == keyframe) {
+      first_skipped = keyframe + 1;
+    }
+    if (first_skipped != -1) {
+      for (i64 f = first_skipped; f < next_keyframe; ++f) {
+        map.packets[f - map.start] = true;
+        map.frames[f - map.start] = true;
+        map.empty = false;
+      }
+    }
+  }
+
+  // Nothing depends on non-reference frames, so unrequested ones are skipped
+  for (i32 i = 0; i < args.non_reference_frames_size(); ++i) {
+    i64 frame = args.non_reference_frames(i);
+    i64 packet = args.non_reference_packets(i);
+    if (!std::binary_search(valid.begin(), valid.end(), frame)) {
+      map.packets[packet - map.start] = true;
+      map.frames[frame - map.start] = true;
+      map.empty = false;
+    }
+  }
+  return map;
+}
+
 void DecoderAutomata::initialize(
     const std::vector<proto::DecodeArgs> &encoded_data) {
+  std::vector<EncodedVideo> videos;
+  for (const proto::DecodeArgs &args : encoded_data) {
+    videos.push_back(encoded_video_from_args(args));
+  }
+  initialize(videos);
+}
+
+void DecoderAutomata::initialize(
+    const std::vector<EncodedVideo> &encoded_data) {
   assert(!encoded_data.empty());
+
+  std::unique_lock<std::mutex> lk(feeder_mutex_);
+  wake_feeder_.wait(lk, [this] { return feeder_waiting_.load(); });
+
+  std::vector<SkipMap> skip_maps;
+  for (const EncodedVideo &video : encoded_data) {
+    skip_maps.push_back(make_skip_map(video.args));
+  }
+
+  size_t resume_offset = 0;
+  bool continuing = can_continue(encoded_data, skip_maps, resume_offset);
+
   encoded_data_ = encoded_data;
-  frame_size_ = encoded_data[0].width() * encoded_data[0].height() * 3;
-  current_frame_ = encoded_data[0].start_keyframe();
-  next_frame_.store(encoded_data[0].valid_frames(0), std::memory_order_release);
+  skip_maps_ = std::move(skip_maps);
+  output_data_idx_ = 0;
+  const proto::DecodeArgs &first = encoded_data[0].args;
+  FrameInfo info = decoded_frame_info(first);
+  frame_size_ = decoded_frame_size(first);
+  next_frame_.store(first.valid_frames(0), std::memory_order_release);
   retriever_data_idx_.store(0, std::memory_order_release);
   retriever_valid_idx_ = 0;
   reset_current_frame_ = -1;
 
-  FrameInfo info;
-  info.set_width(encoded_data[0].width());
-  info.set_height(encoded_data[0].height());
+  if (continuing) {
+    // Frames already buffered in the decoder are still valid, so only the
+    // feeder position moves into the new data
+    i64 next_keyframe = first.end_keyframe();
+    for (i64 k : first.keyframes()) {
+      if (k > feeder_current_frame_) {
+        next_keyframe = k;
+        break;
+      }
+    }
+    feeder_data_idx_.store(0);
+    feeder_buffer_offset_.store(resume_offset);
+    feeder_next_keyframe_.store(next_keyframe);
+    std::atomic_thread_fence(std::memory_order_release);
+    return;
+  }
 
-  while (decoder_->discard_frame()) {
+  // The first GOPs may be skipped entirely, keyframe included, in which case
+  // the first frame out of the decoder comes after them
+  current_frame_ = first.start_keyframe();
+  while (skip_maps_[0].skip_frame(current_frame_)) {
+    current_frame_++;
   }
 
-  std::unique_lock<std::mutex> lk(feeder_mutex_);
-  wake_feeder_.wait(lk, [this] { return feeder_waiting_.load(); });
+  while (decoder_->discard_frame()) {
+  }
 
   if (info_.width() != info.width()
-      || info_.height() != info.height()) {
+      || info_.height() != info.height()
+      || info_.format() != info.format()) {
     decoder_->configure(info);
   }
   if (frames_retrieved_ > 0) {
     decoder_->feed(nullptr, 0, true);
   }
 
-  feeder_data_idx_.store(0, std::memory_order_release);
-  feeder_buffer_offset_.store(0, std::memory_order_release);
-  feeder_next_keyframe_.store(encoded_data[0].keyframes(1),
-                              std::memory_order_release);
   feeder_data_idx_.store(0);
   feeder_buffer_offset_.store(0);
-  feeder_next_keyframe_.store(encoded_data[0].keyframes(1));
+  feeder_next_keyframe_.store(first.keyframes(1));
+  feeder_current_frame_.store(first.start_keyframe());
   info_ = info;
   std::atomic_thread_fence(std::memory_order_release);
   seeking_ = false;
 }
 
+bool DecoderAutomata::can_continue(
+    const std::vector<EncodedVideo> &encoded_data,
+    const std::vector<SkipMap> &skip_maps, size_t &resume_offset) {
+  // The feeder must be part way through the last segment it was given. Once
+  // it reaches the end of a segment the decoder is drained and has to be
+  // flushed before it accepts more data.
+  if (encoded_data_.empty() || seeking_ ||
+      feeder_data_idx_ != (i32)encoded_data_.size() - 1) {
+    return false;
+  }
+  const proto::DecodeArgs &last = encoded_data_.back().args;
+  const proto::DecodeArgs &next = encoded_data[0].args;
+  if (last.table_id() != next.table_id() ||
+      last.column_id() != next.column_id() ||
+      last.item_id() != next.item_id() || last.width() != next.width() ||
+      last.height() != next.height() || last.format() != next.format() ||
+      last.output_width() != next.output_width() ||
+      last.output_height() != next.output_height()) {
+    return false;
+  }
+  // Frame numbering across skipped packets is only tracked within a segment
+  if (!skip_maps_.back().empty || !skip_maps[0].empty) {
+    return false;
+  }
+  // Resuming must not skip any requested frame and must not need packets
+  // before the start of the new data
+  i64 resume_frame = feeder_current_frame_;
+  if (next.valid_frames(0) < current_frame_ ||
+      resume_frame < next.start_keyframe() ||
+      resume_frame >= next.end_keyframe()) {
+    return false;
+  }
+
+  // Walk the packets from the closest keyframe to find the resume point
+  i32 k = 0;
+  while (k + 1 < next.keyframes_size() &&
+         next.keyframes(k + 1) <= resume_frame) {
+    k++;
+  }
+  const EncodedVideo &video = encoded_data[0];
+  size_t offset = next.keyframe_byte_offsets(k);
+  for (i64 f = next.keyframes(k); f < resume_frame; ++f) {
+    if (offset + sizeof(i32) > video.size) {
+      return false;
+    }
+    i32 packet_size = *reinterpret_cast<const i32 *>(video.data + offset);
+    offset += sizeof(i32) + packet_size;
+  }
+  if (offset >= video.size) {
+    return false;
+  }
+  resume_offset = offset;
+  return true;
+}
+
+void DecoderAutomata::set_profiler(Profiler *profiler) {
+  profiler_ = profiler;
+}
+
 void DecoderAutomata::get_frames(u8* buffer, i32 num_frames) {
   i64 total_frames_decoded = 0;
   i64 total_frames_used = 0;
-
-  // profiler_->add_interval("decode", start, now());
-  // profiler_->increment("effective_frames", total_frames_used);
-  // profiler_->increment("decoded_frames", total_frames_decoded);
-
-  auto start = now();
+  double stall_ns = 0;
 
   // Wait until feeder is waiting
   {
@@ -123,17 +317,34 @@ void DecoderAutomata::get_frames(u8* buffer, i32 num_frames) {
   wake_feeder_.notify_one();
 
   while (frames_retrieved_ < frames_to_get_) {
+    {
+      // Frames only show up while the feeder feeds the decoder, so sleep
+      // until it signals that it has fed another packet
+      std::unique_lock<std::mutex> lk(frames_mutex_);
+      auto has_work = [this] {
+        return decoder_->decoded_frames_buffered() > 0 ||
+               reset_current_frame_ != -1;
+      };
+      if (!has_work()) {
+        auto stall_start = now();
+        frames_available_.wait(lk, has_work);
+        stall_ns += nano_since(stall_start);
+      }
+    }
     if (reset_current_frame_ != -1) {
-      printf("reset current frame\n");
+      output_data_idx_ = reset_data_idx_;
       current_frame_ = reset_current_frame_;
       reset_current_frame_ = -1;
+      while (skip_maps_[output_data_idx_].skip_frame(current_frame_)) {
+        current_frame_++;
+      }
     }
     if (decoder_->decoded_frames_buffered() > 0) {
       // New frames
       bool more_frames = true;
       while (more_frames && frames_retrieved_ < frames_to_get_) {
         const auto &valid_frames =
-            encoded_data_[retriever_data_idx_].valid_frames();
+            encoded_data_[retriever_data_idx_].args.valid_frames();
         assert(current_frame_ <= valid_frames.Get(retriever_valid_idx_));
         // printf("has buffered frames, curr %d, next %d\n",
         //        current_frame_, valid_frames.Get(retriever_valid_idx_));
@@ -147,9 +358,10 @@ void DecoderAutomata::get_frames(u8* buffer, i32 num_frames) {
             retriever_valid_idx_ = 0;
           }
           if (retriever_data_idx_ < encoded_data_.size()) {
-            next_frame_.store(encoded_data_[retriever_data_idx_].valid_frames(
-                                  retriever_valid_idx_),
-                              std::memory_order_release);
+            next_frame_.store(
+                encoded_data_[retriever_data_idx_].args.valid_frames(
+                    retriever_valid_idx_),
+                std::memory_order_release);
           }
           // printf("got frame %d\n", frames_retrieved_.load());
           total_frames_used++;
@@ -159,11 +371,32 @@ void DecoderAutomata::get_frames(u8* buffer, i32 num_frames) {
         }
         current_frame_++;
         total_frames_decoded++;
+        // Frames whose packets were left out never come out of the decoder
+        while (skip_maps_[output_data_idx_].skip_frame(current_frame_)) {
+          current_frame_++;
+        }
       }
     }
-    std::this_thread::yield();
+    // Let the feeder refill the decoder
+    {
+      std::unique_lock<std::mutex> lk(frames_mutex_);
+    }
+    frames_consumed_.notify_one();
   }
   decoder_->wait_until_frames_copied();
+
+  if (profiler_) {
+    profiler_->increment("decode_stall_ns", (i64)stall_ns);
+    profiler_->increment("effective_frames", total_frames_used);
+    profiler_->increment("decoded_frames", total_frames_decoded);
+  }
+}
+
+void DecoderAutomata::notify_frames_available() {
+  {
+    std::unique_lock<std::mutex> lk(frames_mutex_);
+  }
+  frames_available_.notify_one();
 }
 
 void DecoderAutomata::feeder() {
@@ -196,27 +429,34 @@ void DecoderAutomata::feeder() {
       // if (next_frame_ > feeder_next_keyframe_) {
       //   // Jump to the next
       // }
-      i32 frames_to_wait = seeking_ ? 0 : 8;
-      while (frames_retrieved_ < frames_to_get_ &&
-            decoder_->decoded_frames_buffered() > frames_to_wait) {
-        std::this_thread::yield();
-        continue;
+      // Keep at most MAX_BUFFERED_FRAMES decoded frames waiting for the
+      // retriever. Before seeking, every frame of the previous segment must
+      // have been retrieved since flushing discards them.
+      i32 frames_to_wait = seeking_ ? 0 : MAX_BUFFERED_FRAMES;
+      {
+        std::unique_lock<std::mutex> lk(frames_mutex_);
+        frames_consumed_.wait(lk, [this, frames_to_wait] {
+          return frames_retrieved_ >= frames_to_get_ ||
+                 (decoder_->decoded_frames_buffered() <= frames_to_wait &&
+                  reset_current_frame_ == -1);
+        });
+      }
+      if (frames_retrieved_ >= frames_to_get_) {
+        break;
       }
       if (seeking_) {
         decoder_->feed(nullptr, 0, true);
-        while (reset_current_frame_ != -1) {
-          std::this_thread::yield();
-        }
-        reset_current_frame_ = encoded_data_[feeder_data_idx_].keyframes(0);
+        reset_data_idx_ = feeder_data_idx_.load();
+        reset_current_frame_ =
+            encoded_data_[feeder_data_idx_].args.keyframes(0);
         seeking_ = false;
+        notify_frames_available();
       }
       frames_fed++;
 
       i32 fdi = feeder_data_idx_.load(std::memory_order_acquire);
-      const u8 *encoded_buffer =
-          (const u8 *)encoded_data_[fdi].mutable_encoded_video()->data();
-      size_t encoded_buffer_size =
-          encoded_data_[fdi].mutable_encoded_video()->size();
+      const u8 *encoded_buffer = encoded_data_[fdi].data;
+      size_t encoded_buffer_size = encoded_data_[fdi].size;
       i32 encoded_packet_size = 0;
       const u8 *encoded_packet = NULL;
       if (feeder_buffer_offset_ < encoded_buffer_size) {
@@ -230,6 +470,12 @@ void DecoderAutomata::feeder() {
         //        encoded_packet);
       }
 
+      if (encoded_packet_size > 0 &&
+          skip_maps_[fdi].skip_packet(feeder_current_frame_)) {
+        feeder_current_frame_++;
+        continue;
+      }
+
       if (seen_metadata && encoded_packet_size > 0) {
         const u8 *start_buffer = encoded_packet;
         i32 original_size = encoded_packet_size;
@@ -250,9 +496,8 @@ void DecoderAutomata::feeder() {
         }
       }
 
-      //if (encoded_packet_size != 0) {
-        decoder_->feed(encoded_packet, encoded_packet_size, false);
-        //}
+      decoder_->feed(encoded_packet, encoded_packet_size, false);
+      notify_frames_available();
       // Set a discontinuity if we sent an empty packet to reset
       // the stream next time
       if (encoded_packet_size == 0) {
@@ -266,11 +511,14 @@ void DecoderAutomata::feeder() {
         if (encoded_data_.size() <= feeder_data_idx_) {
           break;
         }
-        feeder_next_keyframe_ = encoded_data_[feeder_data_idx_].keyframes(1);
+        feeder_next_keyframe_ =
+            encoded_data_[feeder_data_idx_].args.keyframes(1);
+        feeder_current_frame_ =
+            encoded_data_[feeder_data_idx_].args.start_keyframe();
       } else {
         seen_metadata = true;
+        feeder_current_frame_++;
       }
-      std::this_thread::yield();
     }
   }
 }
@@ -25,6 +25,35 @@
 namespace scanner {
 namespace internal {
 
+// An interval of encoded video to decode. The encoded bytes are kept out of
+// the decode args so that they are read once into their row and never
+// serialized.
+struct EncodedVideo {
+  proto::DecodeArgs args;
+  // Owns the row data points into
+  std::shared_ptr<const u8> buffer;
+  const u8* data = nullptr;
+  size_t size = 0;
+};
+
+// Allocates a row holding args followed by room for encoded_size bytes of
+// encoded video, which should be written to encoded_data
+u8* new_encoded_video_row(const proto::DecodeArgs& args, size_t encoded_size,
+                          u8*& encoded_data, size_t& row_size);
+
+// Takes ownership of a row allocated by new_encoded_video_row
+EncodedVideo parse_encoded_video_row(DeviceHandle device, u8* row,
+                                     size_t row_size);
+
+// Moves the encoded_video field of args into its own buffer
+EncodedVideo encoded_video_from_args(proto::DecodeArgs args);
+
+// Size and format of the frames decoded from args
+FrameInfo decoded_frame_info(const proto::DecodeArgs& args);
+
+// Bytes of each frame decoded from args
+size_t decoded_frame_size(const proto::DecodeArgs& args);
+
 class DecoderAutomata {
   DecoderAutomata() = delete;
   DecoderAutomata(const DecoderAutomata&) = delete;
@@ -34,13 +63,52 @@ public:
                   VideoDecoderType decoder_type);
   ~DecoderAutomata();
 
+  // Prepares to decode the valid frames of encoded_data. If encoded_data
+  // picks up the same video where the previously fed data left off, the
+  // decoder keeps its state and resumes feeding from that point instead of
+  // seeking back to the first keyframe.
+  void initialize(const std::vector<EncodedVideo>& encoded_data);
+
   void initialize(const std::vector<proto::DecodeArgs>& encoded_data);
 
   void get_frames(u8* buffer, i32 num_frames);
 
+  // Records decode stall time and decoded versus used frame counts
+  void set_profiler(Profiler* profiler);
+
 private:
+  // Packets of an entry of encoded_data_ the feeder leaves out, and the frames
+  // that are consequently never output, indexed from start_keyframe. A packet
+  // is left out if it holds a non-reference frame that was not requested, or
+  // if the only frame requested from its GOP is the keyframe.
+  struct SkipMap {
+    i64 start;
+    std::vector<bool> packets;
+    std::vector<bool> frames;
+    bool empty = true;
+
+    bool skip_packet(i64 packet) const {
+      return !empty && packets[packet - start];
+    }
+    bool skip_frame(i64 frame) const {
+      return !empty && frame >= start && frame - start < (i64)frames.size() &&
+             frames[frame - start];
+    }
+  };
+
+  static SkipMap make_skip_map(const proto::DecodeArgs& args);
+
   void feeder();
 
+  // Wakes the retriever after the feeder has changed the decoder state
+  void notify_frames_available();
+
+  // Returns true if the decoder can continue into encoded_data and sets
+  // resume_offset to the byte offset of the next packet to feed
+  bool can_continue(const std::vector<EncodedVideo>& encoded_data,
+                    const std::vector<SkipMap>& skip_maps,
+                    size_t& resume_offset);
+
   const i32 MAX_BUFFERED_FRAMES = 8;
 
   DeviceHandle device_handle_;
@@ -55,7 +123,11 @@ private:
   size_t frame_size_;
   i32 current_frame_;
   std::atomic<i32> reset_current_frame_;
-  std::vector<proto::DecodeArgs> encoded_data_;
+  std::vector<EncodedVideo> encoded_data_;
+  std::vector<SkipMap> skip_maps_;
+  // Entry of encoded_data_ the frames coming out of the decoder belong to
+  i32 output_data_idx_;
+  std::atomic<i32> reset_data_idx_;
 
   std::atomic<i64> next_frame_;
   std::atomic<i64> frames_retrieved_;
@@ -68,9 +140,19 @@ private:
   std::atomic<i32> feeder_data_idx_;
   std::atomic<size_t> feeder_buffer_offset_;
   std::atomic<i64> feeder_next_keyframe_;
+  // Frame index of the next packet to be fed
+  std::atomic<i64> feeder_current_frame_;
   std::mutex feeder_mutex_;
   std::condition_variable wake_feeder_;
 
+  // Handoff of decoded frames between the feeder and the retriever. The
+  // decoder buffers at most MAX_BUFFERED_FRAMES frames ahead of the retriever.
+  std::mutex frames_mutex_;
+  std::condition_variable frames_available_;
+  std::condition_variable frames_consumed_;
+
+  Profiler* profiler_ = nullptr;
+
 };
 
 }
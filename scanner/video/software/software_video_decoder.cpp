@@ -35,13 +35,51 @@ extern "C" {
 namespace scanner {
 namespace internal {
 
+namespace {
+
+AVPixelFormat output_pixel_format(FrameFormat format) {
+  switch (format) {
+  case FrameFormat::RGB24:
+    return AV_PIX_FMT_RGB24;
+  case FrameFormat::I420:
+    return AV_PIX_FMT_YUV420P;
+  case FrameFormat::NV12:
+    return AV_PIX_FMT_NV12;
+  case FrameFormat::GRAY8:
+    return AV_PIX_FMT_GRAY8;
+  default:
+    LOG(FATAL) << "Unsupported frame format " << format;
+  }
+  return AV_PIX_FMT_NONE;
+}
+
+// Decoder formats whose first plane is 8 bit luma, so a gray frame is a
+// copy of that plane
+bool has_8bit_luma_plane(AVPixelFormat format) {
+  switch (format) {
+  case AV_PIX_FMT_YUV420P:
+  case AV_PIX_FMT_YUVJ420P:
+  case AV_PIX_FMT_YUV422P:
+  case AV_PIX_FMT_YUVJ422P:
+  case AV_PIX_FMT_YUV444P:
+  case AV_PIX_FMT_YUVJ444P:
+  case AV_PIX_FMT_NV12:
+  case AV_PIX_FMT_GRAY8:
+    return true;
+  default:
+    return false;
+  }
+}
+
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// SoftwareVideoDecoder
 SoftwareVideoDecoder::SoftwareVideoDecoder(i32 device_id,
                                            DeviceType output_type,
                                            i32 thread_count)
     : device_id_(device_id), output_type_(output_type), codec_(nullptr),
-      cc_(nullptr), reset_context_(true), sws_context_(nullptr) {
+      cc_(nullptr), sws_context_(nullptr) {
   avcodec_register_all();
 
   if (output_type != DeviceType::CPU && output_type != DeviceType::GPU) {
@@ -93,10 +131,10 @@ void SoftwareVideoDecoder::configure(const FrameInfo &metadata) {
   metadata_ = metadata;
   frame_width_ = metadata_.width();
   frame_height_ = metadata_.height();
-  reset_context_ = true;
+  output_pixel_format_ = output_pixel_format(metadata_.format());
 
-  int required_size = av_image_get_buffer_size(AV_PIX_FMT_RGB24, frame_width_,
-                                               frame_height_, 1);
+  int required_size = av_image_get_buffer_size(
+      output_pixel_format_, frame_width_, frame_height_, 1);
 
   conversion_buffer_.resize(required_size);
 }
@@ -287,26 +325,6 @@ bool SoftwareVideoDecoder::get_frame(u8 *decoded_buffer, size_t decoded_size) {
     }
   }
 
-  if (reset_context_) {
-    auto get_context_start = now();
-    AVPixelFormat decoder_pixel_format = cc_->pix_fmt;
-    sws_context_ =
-        sws_getCachedContext(sws_context_, frame_width_, frame_height_,
-                             decoder_pixel_format, frame_width_, frame_height_,
-                             AV_PIX_FMT_RGB24, SWS_BICUBIC, NULL, NULL, NULL);
-    reset_context_ = false;
-    auto get_context_end = now();
-    if (profiler_) {
-      profiler_->add_interval("ffmpeg:get_sws_context", get_context_start,
-                              get_context_end);
-    }
-  }
-
-  if (sws_context_ == NULL) {
-    fprintf(stderr, "Could not get sws_context for rgb conversion\n");
-    exit(EXIT_FAILURE);
-  }
-
   u8 *scale_buffer = nullptr;
   if (output_type_ == DeviceType::GPU) {
     scale_buffer = conversion_buffer_.data();
@@ -314,24 +332,66 @@ bool SoftwareVideoDecoder::get_frame(u8 *decoded_buffer, size_t decoded_size) {
     scale_buffer = decoded_buffer;
   }
 
-  uint8_t *out_slices[4];
-  int out_linesizes[4];
-  int required_size =
-      av_image_fill_arrays(out_slices, out_linesizes, scale_buffer,
-                           AV_PIX_FMT_RGB24, frame_width_, frame_height_, 1);
+  int required_size = av_image_get_buffer_size(
+      output_pixel_format_, frame_width_, frame_height_, 1);
   if (required_size < 0) {
-    fprintf(stderr, "Error in av_image_fill_arrays\n");
+    fprintf(stderr, "Error in av_image_get_buffer_size\n");
     exit(EXIT_FAILURE);
   }
   if (required_size > decoded_size) {
     fprintf(stderr, "Decode buffer not large enough for image\n");
     exit(EXIT_FAILURE);
   }
+
+  // The decoder already produces YUV, so planar and gray outputs are plain
+  // plane copies. Color conversion is only paid for when it was asked for.
+  AVPixelFormat frame_format = static_cast<AVPixelFormat>(frame->format);
+  bool same_size =
+      frame->width == frame_width_ && frame->height == frame_height_;
   auto scale_start = now();
-  if (sws_scale(sws_context_, frame->data, frame->linesize, 0, frame->height,
-                out_slices, out_linesizes) < 0) {
-    fprintf(stderr, "sws_scale failed\n");
-    exit(EXIT_FAILURE);
+  if (same_size && frame_format == output_pixel_format_) {
+    if (av_image_copy_to_buffer(scale_buffer, required_size, frame->data,
+                                frame->linesize, frame_format, frame_width_,
+                                frame_height_, 1) < 0) {
+      fprintf(stderr, "av_image_copy_to_buffer failed\n");
+      exit(EXIT_FAILURE);
+    }
+  } else if (same_size && output_pixel_format_ == AV_PIX_FMT_GRAY8 &&
+             has_8bit_luma_plane(frame_format)) {
+    av_image_copy_plane(scale_buffer, frame_width_, frame->data[0],
+                        frame->linesize[0], frame_width_, frame_height_);
+  } else {
+    // The source size can change between videos even when the output does
+    // not, so the context is checked against every frame. It is only rebuilt
+    // when something changed.
+    auto get_context_start = now();
+    sws_context_ = sws_getCachedContext(
+        sws_context_, frame->width, frame->height, frame_format, frame_width_,
+        frame_height_, output_pixel_format_, SWS_BICUBIC, NULL, NULL, NULL);
+    auto get_context_end = now();
+    if (profiler_) {
+      profiler_->add_interval("ffmpeg:get_sws_context", get_context_start,
+                              get_context_end);
+    }
+
+    if (sws_context_ == NULL) {
+      fprintf(stderr, "Could not get sws_context for frame conversion\n");
+      exit(EXIT_FAILURE);
+    }
+
+    uint8_t *out_slices[4];
+    int out_linesizes[4];
+    if (av_image_fill_arrays(out_slices, out_linesizes, scale_buffer,
+                             output_pixel_format_, frame_width_,
+                             frame_height_, 1) < 0) {
+      fprintf(stderr, "Error in av_image_fill_arrays\n");
+      exit(EXIT_FAILURE);
+    }
+    if (sws_scale(sws_context_, frame->data, frame->linesize, 0, frame->height,
+                  out_slices, out_linesizes) < 0) {
+      fprintf(stderr, "sws_scale failed\n");
+      exit(EXIT_FAILURE);
+    }
   }
   auto scale_end = now();
 
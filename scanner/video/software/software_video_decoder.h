@@ -67,8 +67,8 @@ class SoftwareVideoDecoder : public VideoDecoder {
   FrameInfo metadata_;
   i32 frame_width_;
   i32 frame_height_;
+  AVPixelFormat output_pixel_format_;
   std::vector<u8> conversion_buffer_;
-  bool reset_context_;
   SwsContext* sws_context_;
 
   std::mutex frame_mutex_;
@@ -11,6 +11,20 @@
 
 namespace scanner {
 
+std::tuple<i32, i32> net_max_frame_size(const proto::NetDescriptor &descriptor) {
+  if (descriptor.input_width() == -1 || descriptor.input_height() == -1 ||
+      descriptor.preserve_aspect_ratio()) {
+    return std::make_tuple(0, 0);
+  }
+  return std::make_tuple(descriptor.input_width(), descriptor.input_height());
+}
+
+std::tuple<i32, i32> caffe_input_max_frame_size(const Kernel::Config &config) {
+  proto::CaffeInputArgs args;
+  args.ParseFromArray(config.args.data(), config.args.size());
+  return net_max_frame_size(args.net_descriptor());
+}
+
 CaffeInputKernel::CaffeInputKernel(const Kernel::Config &config)
     : VideoKernel(config), device_(config.devices[0]) {
   args_.ParseFromArray(config.args.data(), config.args.size());
@@ -13,6 +13,12 @@
 
 namespace scanner {
 
+// Nets that stretch frames to a fixed input size do not need frames larger
+// than it, so they can be shrunk while decoding
+std::tuple<i32, i32> net_max_frame_size(const proto::NetDescriptor& descriptor);
+
+std::tuple<i32, i32> caffe_input_max_frame_size(const Kernel::Config& config);
+
 class CaffeInputKernel : public VideoKernel {
 public:
   CaffeInputKernel(const Kernel::Config& config);
@@ -8,5 +8,6 @@ REGISTER_OP(CaffeInput)
 
 REGISTER_KERNEL(CaffeInput, CaffeInputKernel)
     .device(DeviceType::CPU)
-    .num_devices(1);
+    .num_devices(1)
+    .max_frame_size(caffe_input_max_frame_size);
 }
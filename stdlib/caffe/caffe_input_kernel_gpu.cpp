@@ -4,5 +4,6 @@ namespace scanner {
 
 REGISTER_KERNEL(CaffeInput, CaffeInputKernel)
     .device(DeviceType::GPU)
-    .num_devices(1);
+    .num_devices(1)
+    .max_frame_size(caffe_input_max_frame_size);
 }
@@ -1,4 +1,5 @@
 #include "stdlib/caffe/caffe_kernel.h"
+#include "stdlib/caffe/caffe_input_kernel.h"
 #include "scanner/engine/db.h"
 
 #include "caffe/blob.hpp"
@@ -218,6 +219,12 @@ bool file_exists(const std::string& path) {
   return stat(path.c_str(), &buffer) == 0;
 }
 
+std::tuple<i32, i32> caffe_max_frame_size(const Kernel::Config &config) {
+  proto::CaffeArgs args;
+  args.ParseFromArray(config.args.data(), config.args.size());
+  return net_max_frame_size(args.net_descriptor());
+}
+
 CaffeKernel::CaffeKernel(const Kernel::Config &config)
     : VideoKernel(config), device_(config.devices[0]) {
   valid_.set_success(true);
@@ -18,6 +18,8 @@ namespace scanner {
 using CustomNetConfiguration = void (*)(const FrameInfo &frame_info,
                                         caffe::Net<float> *net);
 
+std::tuple<i32, i32> caffe_max_frame_size(const Kernel::Config& config);
+
 class CaffeKernel : public VideoKernel {
 public:
   CaffeKernel(const Kernel::Config& config);
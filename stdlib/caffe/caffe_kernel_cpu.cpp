@@ -5,5 +5,8 @@ namespace scanner {
 REGISTER_OP(Caffe)
     .inputs({"caffe_frame", "frame_info"})
     .outputs({"caffe_output"});
-REGISTER_KERNEL(Caffe, CaffeKernel).device(DeviceType::CPU).num_devices(1);
+REGISTER_KERNEL(Caffe, CaffeKernel)
+    .device(DeviceType::CPU)
+    .num_devices(1)
+    .max_frame_size(caffe_max_frame_size);
 }
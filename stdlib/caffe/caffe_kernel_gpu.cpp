@@ -2,6 +2,9 @@
 
 namespace scanner {
 
-REGISTER_KERNEL(Caffe, CaffeKernel).device(DeviceType::GPU).num_devices(1);
+REGISTER_KERNEL(Caffe, CaffeKernel)
+    .device(DeviceType::GPU)
+    .num_devices(1)
+    .max_frame_size(caffe_max_frame_size);
 
 }
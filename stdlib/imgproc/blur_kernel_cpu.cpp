@@ -58,10 +58,12 @@ public:
     i32 width = frame_width_;
     i32 height = frame_height_;
     size_t frame_size = width * height * 3 * sizeof(u8);
+    u8 *output_block =
+        new_block_buffer(CPU_DEVICE, frame_size * input_count, input_count);
 
     for (i32 i = 0; i < input_count; ++i) {
       u8 *input_buffer = input_columns[0].rows[i].buffer;
-      u8 *output_buffer = new u8[frame_size];
+      u8 *output_buffer = output_block + frame_size * i;
 
       u8 *frame_buffer = input_buffer;
       u8 *blurred_buffer = (output_buffer);
@@ -38,9 +38,15 @@ public:
         new_block_buffer(device_, out_buf_size * input_count, input_count);
 
     for (i32 i = 0; i < input_count; ++i) {
-      cv::Mat input(frame_info_.height(), frame_info_.width(), CV_8UC3,
-                    input_columns[0].rows[i].buffer);
-      cv::cvtColor(input, grayscale_[i], CV_BGR2GRAY);
+      if (frame_info_.format() == FrameFormat::GRAY8) {
+        cv::Mat input(frame_info_.height(), frame_info_.width(), CV_8UC1,
+                      input_columns[0].rows[i].buffer);
+        input.copyTo(grayscale_[i]);
+      } else {
+        cv::Mat input(frame_info_.height(), frame_info_.width(), CV_8UC3,
+                      input_columns[0].rows[i].buffer);
+        cv::cvtColor(input, grayscale_[i], CV_BGR2GRAY);
+      }
     }
 
     double start = CycleTimer::currentSeconds();
@@ -79,5 +85,6 @@ REGISTER_OP(OpticalFlow).outputs({"flow"});
 
 REGISTER_KERNEL(OpticalFlow, OpticalFlowKernelCPU)
     .device(DeviceType::CPU)
-    .num_devices(1);
+    .num_devices(1)
+    .frame_formats({FrameFormat::GRAY8, FrameFormat::RGB24});
 }